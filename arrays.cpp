@@ -0,0 +1,304 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/IR/MDBuilder.h>
+#include <cctype>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Arrays
+//
+// Dim a(n) As Double gives the elements 0 to n, in one contiguous,
+// aligned block. The array variable itself only holds the pointer
+// to the elements:
+//   - a small constant size goes on the stack (static alloca)
+//   - anything else goes on the heap, and is released when main()
+//     returns, or by the next Dim/ReDim of the same array
+//   - in incremental mode the arrays must outlive the statement,
+//     so they are always on the heap, with the pointer in a global
+//   - the elements of a String array own their characters, the array
+//     keeps its number of elements to release them first
+//   - a dynamic array keeps its number of elements too, every index is
+//     checked against it (or against the constant size of a fixed
+//     array), and an index out of range ends the program
+//
+// BASIC has no pointers, so two arrays never overlap. Every element
+// access gets the alias scope of its array, and is marked as not
+// aliasing the other arrays, nor the plain variables. That is what
+// lets the loop vectorizer work when the array pointers are loaded
+// from globals.
+/////////////////////////////////////////////////////////////////////////
+
+// bigger arrays go on the heap
+static const uint64_t ARRAY_STACK_LIMIT = 64 * 1024;
+// enough for AVX loads and stores
+static const unsigned ARRAY_ALIGNMENT = 32;
+
+Value* interpreter::make_index(Value* pVal, ir_builder& builder)
+{
+	Type* t = pVal->getType();
+	if (is_variable(pVal))
+	{
+		t = get_variable_type(pVal);
+		pVal = builder.CreateLoad(pVal);
+	}
+
+	Type* i64 = builder.getInt64Ty();
+	if (t == i64)
+		return pVal;
+	if (t->isIntegerTy())
+	{
+		m_stats.count_cast();
+		return builder.CreateIntCast(pVal, i64, is_signed_type(t));
+	}
+	if (t->isFloatingPointTy())
+	{
+		m_stats.count_cast();
+		return builder.CreateFPToSI(pVal, i64);
+	}
+	return nullptr;
+}
+
+Value* interpreter::create_array(int nType, const char* pszname, Value* pSize, BasicBlock* bb)
+{
+	if (m_symbols.lookup_local(pszname))
+	{
+		std::cerr << "WARNING: variable " << pszname << " is already defined, the previous definition is used.\n";
+		return find_variable(pszname);
+	}
+
+	Type* elemType = get_llvm_type(nType);
+	PointerType* ptrType = elemType->getPointerTo();
+	bool bGlobal = m_incremental && m_symbols.depth() == 1;
+
+	bool bFixed = false;
+	uint64_t nCount = 0;
+	if (pSize && ConstantInt::classof(pSize))
+	{
+		int64_t nBound = static_cast<ConstantInt*>(pSize)->getSExtValue();
+		if (nBound < 0)
+		{
+			std::cerr << "error: the upper bound of " << pszname << " must not be negative.\n";
+			return nullptr;
+		}
+		bFixed = true;
+		nCount = static_cast<uint64_t>(nBound) + 1;
+	}
+	uint64_t nBytes = nCount * module->getDataLayout().getTypeAllocSize(elemType);
+	bool bStack = bFixed && !bGlobal && nBytes <= ARRAY_STACK_LIMIT;
+
+	Value* storage = nullptr;
+	Value* count = nullptr;
+	bool bString = elemType == m_stringType;
+	bool bCount = bString || !bFixed;
+	Type* i64 = Type::getInt64Ty(*this);
+	if (bGlobal)
+	{
+		std::string strName(pszname);
+		for (auto& c: strName)
+			c = tolower(static_cast<unsigned char>(c));
+		storage = new GlobalVariable(*(module.get()), ptrType, false,
+				GlobalVariable::ExternalLinkage, ConstantPointerNull::get(ptrType), strName);
+		if (bCount)
+			count = new GlobalVariable(*(module.get()), i64, false,
+					GlobalVariable::ExternalLinkage, ConstantInt::get(i64, 0), strName + ".count");
+	}
+	else
+	{
+		// the pointer starts out null, so it can be released
+		// on exit even if the Dim itself was never reached
+		BasicBlock* entry = &(bb->getParent()->getEntryBlock());
+		ir_builder builder(entry, entry->getFirstInsertionPt());
+		storage = builder.CreateAlloca(ptrType, nullptr, pszname);
+		builder.CreateStore(ConstantPointerNull::get(ptrType), storage);
+		if (bCount)
+		{
+			count = builder.CreateAlloca(i64, nullptr, std::string(pszname) + ".count");
+			builder.CreateStore(builder.getInt64(0), count);
+		}
+	}
+
+	symbol* sym = m_symbols.insert(pszname, symbol{ nType, ptrType, storage });
+	sym->isArray = true;
+	sym->isFixed = bFixed;
+	sym->count = count;
+	sym->fixedCount = nCount;
+	sym->scope = MDBuilder(*this).createAnonymousAliasScope(m_aliasDomain, pszname);
+	// the arrays Dim'd later list this one in their own !noalias,
+	// ScopedNoAliasAA looks at both sides of a pair of accesses
+	SmallVector<Metadata*, 8> others;
+	others.push_back(m_variableScope);
+	others.append(m_arrayScopes.begin(), m_arrayScopes.end());
+	sym->aliasScopes = MDNode::get(*this, ArrayRef<Metadata*>(sym->scope));
+	sym->noalias = MDNode::get(*this, others);
+	m_arrayScopes.push_back(sym->scope);
+	m_arrays.insert(storage);
+	if (bString && !bGlobal)
+		m_stringArrays.push_back(std::make_pair(storage, count));
+
+	ir_builder builder(m_activeBlock);
+	if (bStack)
+	{
+		BasicBlock* entry = &(bb->getParent()->getEntryBlock());
+		ir_builder eb(entry, entry->getFirstInsertionPt());
+		AllocaInst* elems = eb.CreateAlloca(elemType, eb.getInt64(nCount), std::string(pszname) + ".elems");
+		elems->setAlignment(ARRAY_ALIGNMENT);
+
+		// a Dim in a loop finds the Strings of the previous pass
+		if (bString)
+			free_string_elements(sym, elems, builder);
+		// BASIC variables start out as zero
+		builder.CreateMemSet(elems, builder.getInt8(0), nBytes, ARRAY_ALIGNMENT);
+		builder.CreateStore(elems, storage);
+		if (bString)
+			builder.CreateStore(builder.getInt64(nCount), count);
+		return storage;
+	}
+
+	if (pSize)
+		allocate_array(sym, pSize, builder);
+	if (!bGlobal)
+		m_heapArrays.push_back(storage);
+	return storage;
+}
+
+void interpreter::allocate_array(symbol* sym, Value* pSize, ir_builder& builder)
+{
+	Type* i8ptr = builder.getInt8PtrTy();
+	Type* i64 = builder.getInt64Ty();
+	Type* argTypes[] = { i64, i64 };
+	Constant* allocFn = module->getOrInsertFunction("aligned_alloc",
+			FunctionType::get(i8ptr, ArrayRef<Type*>(argTypes), false));
+	Constant* freeFn = module->getOrInsertFunction("free",
+			FunctionType::get(builder.getVoidTy(), ArrayRef<Type*>(i8ptr), false));
+
+	// a Dim in a loop, or a ReDim, replaces the previous elements
+	Value* pOld = builder.CreateLoad(sym->storage);
+	if (sym->typeId == STRING)
+		free_string_elements(sym, pOld, builder);
+	builder.CreateCall(freeFn, builder.CreateBitCast(pOld, i8ptr));
+
+	Value* pCount = builder.CreateAdd(make_index(pSize, builder), builder.getInt64(1));
+	Type* elemType = sym->type->getPointerElementType();
+	Value* pBytes = builder.CreateMul(pCount, ConstantExpr::getSizeOf(elemType));
+	// aligned_alloc wants the size to be a multiple of the alignment
+	pBytes = builder.CreateAnd(builder.CreateAdd(pBytes, builder.getInt64(ARRAY_ALIGNMENT - 1)),
+			builder.getInt64(~static_cast<uint64_t>(ARRAY_ALIGNMENT - 1)));
+
+	Value* args[] = { builder.getInt64(ARRAY_ALIGNMENT), pBytes };
+	CallInst* pMem = builder.CreateCall(allocFn, ArrayRef<Value*>(args));
+	pMem->addAttribute(AttributeList::ReturnIndex, Attribute::NoAlias);
+	pMem->addAttribute(AttributeList::ReturnIndex, Attribute::getWithAlignment(*this, ARRAY_ALIGNMENT));
+	// no elements at all may give a null pointer too
+	make_error_check(builder, builder.CreateAnd(builder.CreateIsNull(pMem),
+				builder.CreateIsNotNull(pBytes)), "basic_memory_error");
+
+	builder.CreateMemSet(pMem, builder.getInt8(0), pBytes, ARRAY_ALIGNMENT);
+	builder.CreateStore(builder.CreateBitCast(pMem, sym->type), sym->storage);
+	if (sym->count)
+		builder.CreateStore(pCount, sym->count);
+}
+
+void interpreter::free_string_elements(symbol* sym, Value* pElems, ir_builder& builder)
+{
+	// the count is 0 until the first Dim, pElems may still be null
+	Value* args[] = { pElems, builder.CreateLoad(sym->count) };
+	call_runtime(builder, "basic_str_free_array", builder.getVoidTy(), args);
+}
+
+bool interpreter::redim_array(const char* pszname, Value* pSize)
+{
+	symbol* sym = m_symbols.lookup(pszname);
+	if (!sym || !sym->isArray)
+	{
+		std::cerr << "error: ReDim: " << pszname << " is not an array.\n";
+		return false;
+	}
+	if (sym->isFixed)
+	{
+		std::cerr << "error: ReDim: " << pszname << " has a fixed size.\n";
+		return false;
+	}
+
+	// declares it again in incremental mode
+	find_variable(pszname);
+
+	construct_scope cs(m_stats, compile_stats::CONSTRUCT_DIM);
+	ir_builder builder(m_activeBlock);
+	allocate_array(sym, pSize, builder);
+	return true;
+}
+
+Value* interpreter::make_element_ref(const char* pszname, Value* pIndex)
+{
+	Value* storage = find_variable(pszname);
+	if (!storage || !is_array(storage))
+		return nullptr;
+	symbol* sym = m_symbols.lookup(pszname);
+
+	ir_builder builder(m_activeBlock);
+	Value* pIdx = make_index(pIndex, builder);
+	if (!pIdx)
+	{
+		std::cerr << "error: invalid index for " << pszname << "\n";
+		return nullptr;
+	}
+	// unsigned, a negative index is out of range too
+	Value* pCount = sym->isFixed ? builder.getInt64(sym->fixedCount) : builder.CreateLoad(sym->count);
+	make_error_check(builder, builder.CreateICmpUGE(pIdx, pCount), "basic_index_error");
+	Value* pBase = builder.CreateLoad(storage);
+	Value* pElem = builder.CreateInBoundsGEP(pBase, pIdx);
+	m_elements[pElem] = std::make_pair(sym->aliasScopes, sym->noalias);
+	return pElem;
+}
+
+// the arrays and the Strings of the function being left
+void interpreter::free_locals(ir_builder& builder)
+{
+	for (auto pStr: m_stringSlots)
+		call_runtime(builder, "basic_str_free", builder.getVoidTy(), pStr);
+	m_stringSlots.clear();
+
+	// the elements first, the heap arrays are freed below
+	for (auto& arr: m_stringArrays)
+	{
+		Value* args[] = { builder.CreateLoad(arr.first), builder.CreateLoad(arr.second) };
+		call_runtime(builder, "basic_str_free_array", builder.getVoidTy(), args);
+	}
+	m_stringArrays.clear();
+
+	if (m_heapArrays.empty())
+		return;
+	Type* i8ptr = builder.getInt8PtrTy();
+	Constant* freeFn = module->getOrInsertFunction("free",
+			FunctionType::get(builder.getVoidTy(), ArrayRef<Type*>(i8ptr), false));
+	for (auto storage: m_heapArrays)
+		builder.CreateCall(freeFn, builder.CreateBitCast(builder.CreateLoad(storage), i8ptr));
+	m_heapArrays.clear();
+}
+
+void interpreter::annotate_access(Instruction* I)
+{
+	Value* ptr = nullptr;
+	if (LoadInst::classof(I))
+		ptr = static_cast<LoadInst*>(I)->getPointerOperand();
+	else if (StoreInst::classof(I))
+		ptr = static_cast<StoreInst*>(I)->getPointerOperand();
+	else
+		return;
+
+	auto found = m_elements.find(ptr);
+	if (found != m_elements.end())
+	{
+		// an element can only be aliased by the elements of the same array
+		I->setMetadata(LLVMContext::MD_alias_scope, found->second.first);
+		I->setMetadata(LLVMContext::MD_noalias, found->second.second);
+	}
+	else if (GlobalVariable::classof(ptr))
+	{
+		// the allocas are promoted to registers anyway,
+		// only the globals of incremental mode need it
+		I->setMetadata(LLVMContext::MD_alias_scope, m_variableScopes);
+	}
+}
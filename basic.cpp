@@ -4,65 +4,46 @@
 using namespace basic;
 using namespace llvm;
 
-extern basic::interpreter* interp;
+void node_arena::reset()
+{
+	// newest first, just like the stack would do
+	for (auto iter = m_dtors.rbegin(); iter != m_dtors.rend(); iter++)
+		iter->second(iter->first);
+	m_dtors.clear();
+	m_alloc.Reset();
+}
 
 // Toplevel statement
-statement::statement(int tok, const char* sname)
+statement::statement(interpreter* pInterp, int tok, const char* sname)
 {
+	m_interp = pInterp;
 	m_type = tok;
 	m_name = sname;
 	m_next = nullptr;
 	m_prev = nullptr;
 	m_parent = nullptr;
+	m_children = nullptr;
 }
 
-statement::statement(statement* parent, int tok, const char* sname)
+statement::statement(interpreter* pInterp, statement* parent, int tok, const char* sname)
 {
+	m_interp = pInterp;
 	m_type = tok;
 	m_name = sname;
 	m_parent = parent;
 	m_next = m_prev = nullptr;
+	m_children = nullptr;
 }
 
 statement::~statement()
 {
-	if (m_next)
-		m_next->m_prev = m_prev;
-	if (m_prev)
-		m_prev->m_next = m_next;
-	if (m_parent)
-	{
-		if (m_parent->m_children == this)
-			m_parent->m_children = nullptr;
-		m_parent = nullptr;
-	}
-
-	// we are responsible for deleting all of our children,
-	// if we gets deleted.
-	if (m_children)
-	{
-		m_children->m_parent = nullptr;
-
-		// recursively delete next nodes
-		m_children->remove_next();
-		delete m_children;
-	}
-	std::cerr << "statement " << m_name << " deleted\n";
-}
-
-void statement::remove_next()
-{
-	if (m_next)
-	{
-		m_next->remove_next();
-		delete m_next;
-		m_next = nullptr;
-	}
+	// the siblings and children are owned by the same arena,
+	// and they are all destroyed together.
 }
 
 statement* statement::insert_last(int tok, const char* sname)
 {
-	statement* s = new statement(m_parent, tok, sname);
+	statement* s = m_interp->create<statement>(m_interp, m_parent, tok, sname);
 	if (m_next == nullptr)
 	{
 		m_next = s;
@@ -79,7 +60,7 @@ statement* statement::insert_last(int tok, const char* sname)
 
 statement* statement::insert_before(int tok, const char* sname)
 {
-	statement* s = new statement(m_parent, tok, sname);
+	statement* s = m_interp->create<statement>(m_interp, m_parent, tok, sname);
 	m_prev->m_next = s;
 	s->m_next = this;
 	s->m_prev = m_prev;
@@ -89,7 +70,7 @@ statement* statement::insert_before(int tok, const char* sname)
 
 statement* statement::insert_after(int tok, const char* sname)
 {
-	statement* s = new statement(m_parent, tok, sname);
+	statement* s = m_interp->create<statement>(m_interp, m_parent, tok, sname);
 	s->m_next = m_next;
 	m_next->m_prev = s;
 	m_next = s;
@@ -99,31 +80,48 @@ statement* statement::insert_after(int tok, const char* sname)
 /////////////////////////
 // DIM
 /////////////////////////
-dim_stmt::dim_stmt()
-	: statement(DIM, "Dim")
+dim_stmt::dim_stmt(interpreter* pInterp)
+	: statement(pInterp, DIM, "Dim")
 {
-	m_parentBlock = interp->get_entry();
+	// the allocas go into the entry block of the Sub/Function being defined
+	m_parentBlock = &(m_interp->get_current_function()->getEntryBlock());
 }
 
-dim_stmt::dim_stmt(BasicBlock* parentBlock)
-	: statement(DIM, "Dim")
+dim_stmt::dim_stmt(interpreter* pInterp, BasicBlock* parentBlock)
+	: statement(pInterp, DIM, "Dim")
 {
 	m_parentBlock = parentBlock;
 }
 
 dim_stmt::~dim_stmt()
 {
-	std::cerr << "dim_stmt deleted\n";
+	//
+}
+
+Value* dim_stmt::add_variable(int vType, const char* vname)
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_DIM);
+	Value* inst = m_interp->create_variable(vType, vname, m_parentBlock);
+	m_varlist.push_back(inst);
+	if (!m_children)
+	{
+		m_children = m_interp->create<statement>(m_interp, this, vType, vname);
+		return inst;
+	}
+	m_children->insert_last(vType, vname);
+	return inst;
 }
 
-AllocaInst* dim_stmt::add_variable(int vType, const char* vname)
+Value* dim_stmt::add_array(int vType, const char* vname, Value* pSize)
 {
-	IRBuilder<> builder(m_parentBlock);
-	AllocaInst* inst = builder.CreateAlloca(interp->get_llvm_type(vType), nullptr, vname);
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_DIM);
+	Value* inst = m_interp->create_array(vType, vname, pSize, m_parentBlock);
+	if (!inst)
+		return nullptr;
 	m_varlist.push_back(inst);
 	if (!m_children)
 	{
-		m_children = new statement(this, vType, vname);
+		m_children = m_interp->create<statement>(m_interp, this, vType, vname);
 		return inst;
 	}
 	m_children->insert_last(vType, vname);
@@ -134,10 +132,10 @@ void dim_stmt::print_debug()
 {
 	if (m_varlist.empty())
 	{
-		std::cerr << "dim_stmt: empty list\n";
+		trace::write("dim_stmt: empty list");
 		return;
 	}
-	std::string buff;
+	std::string buff("DIM\n");
 	raw_string_ostream rso(buff);
 	for (auto pVal: m_varlist)
 	{
@@ -145,6 +143,6 @@ void dim_stmt::print_debug()
 		pVal->print(rso);
 		rso << "\n";
 	}
-	std::cerr << buff << "\n";
+	trace::write(rso.str());
 }
 
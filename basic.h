@@ -4,7 +4,19 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "trace.h"
+#include "stats.h"
 
 #include <iostream>
 #include <string>
@@ -12,15 +24,98 @@
 #include <variant>
 #include <fstream>
 #include <list>
+#include <map>
+#include <type_traits>
+#include <utility>
 
 
 namespace basic
 {
+	// Bump allocator for the statement nodes and the parser temporaries.
+	// Nothing allocated here is deleted one by one, reset() runs all the
+	// destructors and releases the memory at once.
+	class node_arena
+	{
+	public:
+		node_arena() = default;
+		node_arena(const node_arena&) = delete;
+		node_arena& operator=(const node_arena&) = delete;
+		~node_arena() { reset(); }
+
+		template <typename T, typename... Args>
+		T* create(Args&&... args)
+		{
+			void* mem = m_alloc.Allocate(sizeof(T), alignof(T));
+			T* p = new (mem) T(std::forward<Args>(args)...);
+			if (!std::is_trivially_destructible<T>::value)
+				m_dtors.push_back({ p, [](void* obj) { static_cast<T*>(obj)->~T(); } });
+			return p;
+		}
+
+		// destroy everything, the memory slab is kept for reuse
+		void reset();
+
+		size_t get_bytes_allocated() const { return m_alloc.getBytesAllocated(); }
+
+	private:
+		llvm::BumpPtrAllocator m_alloc;
+		std::vector<std::pair<void*, void (*)(void*)>> m_dtors;
+	};
+
+	// argument lists built by the parser
+	typedef llvm::SmallVector<llvm::Value*, 4> value_list;
+	// Sub/Function parameters, the (interned) name and the BASIC type
+	typedef llvm::SmallVector<std::pair<const char*, int>, 4> param_list;
+	// the values of a Case, a range (Case 1 To 10) has both ends,
+	// a single value leaves the second one null
+	typedef llvm::SmallVector<std::pair<llvm::Value*, llvm::Value*>, 4> case_list;
+
+	// IRBuilder inserter counting the instructions for --stats,
+	// and tagging the memory accesses with their alias scopes.
+	// The interpreter is the context of every instruction we make.
+	class counting_inserter : public llvm::IRBuilderDefaultInserter
+	{
+	protected:
+		void InsertHelper(llvm::Instruction* I, const llvm::Twine& Name,
+				llvm::BasicBlock* BB, llvm::BasicBlock::iterator InsertPt) const;
+	};
+
+	// use this one instead of llvm::IRBuilder<>
+	typedef llvm::IRBuilder<llvm::ConstantFolder, counting_inserter> ir_builder;
+
+	// Integer (i32) and Long (i64) are signed, Boolean (i1) and Byte (i8) are not
+	inline bool is_signed_type(llvm::Type* t)
+	{
+		return t->isIntegerTy() && t->getIntegerBitWidth() > 8;
+	}
+
+	// a select evaluates both sides, more instructions than that
+	// and the branch is cheaper than running them anyway
+	const unsigned MAX_SPECULATED = 8;
+	// [begin, end) is at most MAX_SPECULATED instructions without side
+	// effects, that can run even when they are not needed (logic.cpp)
+	bool is_speculatable(llvm::BasicBlock::iterator begin, llvm::BasicBlock::iterator end);
+
+	// AndAlso/OrElse between the two operands: the left one
+	// as i1, and the block the right one is evaluated in
+	struct short_circuit
+	{
+		llvm::Value* lhs;
+		llvm::BasicBlock* lhsBlock;
+		llvm::BasicBlock* rhsBlock;
+		bool bAndAlso;
+	};
+
+	class interpreter;
+
+	// Statements are owned by the interpreter's node_arena,
+	// never delete them. They build their code through the
+	// interpreter that parsed them, there is no global one.
 	class statement
 	{
 	public:
-		statement(int tok, const char* sname);
-		statement(statement* parent, int tok, const char* sname);
+		statement(interpreter* pInterp, int tok, const char* sname);
+		statement(interpreter* pInterp, statement* parent, int tok, const char* sname);
 		virtual ~statement();
 
 		int type() const { return m_type; }
@@ -44,35 +139,41 @@ namespace basic
 		statement* m_parent;
 		statement* m_next;
 		statement* m_prev;
-	    statement* m_children;
-		void remove_next();
+		statement* m_children;
+		interpreter* m_interp;
 	};
 
 	class dim_stmt : public statement
 	{
 	public:
-		dim_stmt();
-		dim_stmt(llvm::BasicBlock* parentBlock);
+		dim_stmt(interpreter* pInterp);
+		dim_stmt(interpreter* pInterp, llvm::BasicBlock* parentBlock);
 		~dim_stmt();
 
-		const std::list<llvm::AllocaInst*>& get_variable_list() const
+		const std::list<llvm::Value*>& get_variable_list() const
 		{ return m_varlist; }
-		llvm::AllocaInst* add_variable(int nType, const char* vName);
-
+		// the storage is either an AllocaInst, or a GlobalVariable
+		// when the interpreter runs in incremental mode
+		llvm::Value* add_variable(int nType, const char* vName);
+		// Dim a(n), elements 0 to n. pSize is null for Dim a(),
+		// the storage is then allocated by ReDim.
+		llvm::Value* add_array(int nType, const char* vName, llvm::Value* pSize);
+
+		// write the variables to the trace output
 		void print_debug();
 
 	private:
 		llvm::BasicBlock* m_parentBlock;
-		std::list<llvm::AllocaInst*> m_varlist;
+		std::list<llvm::Value*> m_varlist;
 	};
 
 	class if_stmt : public statement
 	{
 	public:
-		if_stmt();
+		if_stmt(interpreter* pInterp);
 		if_stmt(if_stmt* topIf, int tok, const char* _ifname);
-		if_stmt(llvm::BasicBlock* bb);
-		if_stmt(llvm::BasicBlock* bb, llvm::Value* cond);
+		if_stmt(interpreter* pInterp, llvm::BasicBlock* bb);
+		if_stmt(interpreter* pInterp, llvm::BasicBlock* bb, llvm::Value* cond);
 		~if_stmt();
 
 		llvm::BasicBlock* true_block();
@@ -88,6 +189,12 @@ namespace basic
 		llvm::Value* set_branch(llvm::Value* cond);
 		llvm::Value* set_branch();
 		llvm::Value* make_end_if();
+		// ElseIf and Else: close the current arm,
+		// and continue in the false block
+		void begin_next_arm();
+		// If c Then x = 1 [Else x = 2], ended by the end of the line
+		void set_single_line() { m_singleLine = true; }
+		bool is_single_line() const { return m_singleLine; }
 
 	private:
 		llvm::BasicBlock* m_parentBlock;
@@ -96,16 +203,17 @@ namespace basic
 		llvm::BasicBlock* m_trueBlock;
 		llvm::BasicBlock* m_exitBlock;
 		llvm::BasicBlock* m_falseBlock;
+		bool m_singleLine;
 	};
 
 	class for_stmt : public statement
 	{
 	public:
-		for_stmt();
+		for_stmt(interpreter* pInterp);
 		// dont use the following, still tentative, maybe removed
 		for_stmt(for_stmt* top);
 		// use this instead
-		for_stmt(llvm::BasicBlock* parentBlock, llvm::Value* vCounter);
+		for_stmt(interpreter* pInterp, llvm::BasicBlock* parentBlock, llvm::Value* vCounter);
 		~for_stmt();
 
 		llvm::BasicBlock* get_start_block()
@@ -127,24 +235,199 @@ namespace basic
 		// useful for matching next
 		bool is_equal(const char* strId);
 
+		// Exit For, the vectorizer is no longer forced
+		void set_side_exit() { m_sideExit = true; }
+
 	private:
+		llvm::Value* make_exit_test(ir_builder& builder, llvm::Value* pCounter);
+
 		llvm::BasicBlock* m_parentBlock;
 		llvm::BasicBlock* m_startBlock;
 		llvm::BasicBlock* m_loopBlock;
 		llvm::BasicBlock* m_nextBlock;
 		llvm::BasicBlock* m_exitBlock;
-		llvm::Value* m_varCounter; // the counter, must be a variable (AllocaInst)
+		llvm::Value* m_varCounter; // the counter, must be a variable (AllocaInst or GlobalVariable)
 		llvm::Value* m_startValue; // we will assign the start value to the counter
-		llvm::Value* m_endValue;   // must be a constant expr
-		llvm::Value* m_stepValue;  // the caller supply the step, if not then it will be 1, doesnt matter the type
+		llvm::Value* m_endValue;   // evaluated once, in the counter type
+		llvm::Value* m_stepValue;  // the caller supply the step, if not then it will be 1
+		llvm::Value* m_down;       // i1, the step is negative
+		bool m_noWrap;             // constant bounds, the counter can't overflow
+		bool m_sideExit;           // there is an Exit For
+	};
+
+	// Do [While|Until c] ... Loop [While|Until c], rotated like For:
+	// the test repeating the loop is in the latch, at the bottom.
+	// A test after Do is evaluated once before the first iteration,
+	// and copied into the latch for the others.
+	class do_stmt : public statement
+	{
+	public:
+		// bTest: Do While/Until, the condition comes next,
+		// it is built in a block of its own
+		do_stmt(interpreter* pInterp, llvm::BasicBlock* parent, bool bTest);
+		~do_stmt();
+
+		// the condition after Do is done, the body follows
+		void set_test(llvm::Value* cond, bool bUntil);
+		// Loop While/Until: the condition is built in the latch,
+		// false if there was a test after Do already
+		bool begin_loop_test();
+		// Loop, cond is null without a test
+		void make_loop(llvm::Value* cond, bool bUntil);
+
+		llvm::BasicBlock* get_latch_block() { return m_latchBlock; }
+		llvm::BasicBlock* get_exit_block() { return m_exitBlock; }
+
+	private:
+		llvm::BasicBlock* m_parentBlock;
+		llvm::BasicBlock* m_testBlock;  // Do While/Until, null otherwise
+		llvm::BasicBlock* m_testEnd;    // where the condition ended up
+		llvm::Value* m_testCond;
+		llvm::BasicBlock* m_bodyBlock;
+		llvm::BasicBlock* m_latchBlock;
+		llvm::BasicBlock* m_exitBlock;
+		bool m_until;
 	};
 
-	class interpreter : public llvm::LLVMContext
+	// Select Case. The Case values are evaluated in blocks of their own,
+	// End Select chains them: a run of Cases with only Integer/Long
+	// constants becomes one switch, the others compare in order.
+	class select_stmt : public statement
+	{
+	public:
+		// the selector is evaluated once, in parent
+		select_stmt(interpreter* pInterp, llvm::BasicBlock* parent, llvm::Value* selector);
+		~select_stmt();
+
+		// Case: ends the previous arm, the values follow.
+		// Returns false after a Case Else.
+		bool begin_case();
+		// the values are done, the body follows
+		void set_case(const case_list& items);
+		// Case Else, false if there is one already
+		bool set_case_else();
+		// End Select
+		void make_end_select();
+
+	private:
+		struct arm
+		{
+			llvm::BasicBlock* testEntry;
+			llvm::BasicBlock* testEnd;  // where the values ended up
+			llvm::BasicBlock* body;
+			case_list items;
+		};
+		void close_values();
+		// the switch cases of an arm, false if it needs comparisons
+		bool get_switch_cases(const arm& a, llvm::SmallVectorImpl<llvm::ConstantInt*>& cases);
+
+		llvm::BasicBlock* m_parentBlock;
+		llvm::BasicBlock* m_exitBlock;
+		llvm::BasicBlock* m_elseBlock;
+		llvm::Value* m_selector;
+		std::vector<arm> m_arms;
+	};
+
+	// Sub and Function definitions.
+	// The statement stays on the context list until End Sub/Function,
+	// everything in between goes into the procedure's own function.
+	class sub_stmt : public statement
+	{
+	public:
+		sub_stmt(interpreter* pInterp, int tok, const char* name);
+		~sub_stmt();
+
+		// create the function and start its body,
+		// nRetType is the BASIC type of a Function, ignored for a Sub.
+		// Returns false if the name is already taken.
+		bool define(const param_list& params, int nRetType);
+
+		// Exit Sub/Function
+		void make_exit();
+		// End Sub/Function
+		void make_end();
+
+		llvm::Function* get_function() { return m_function; }
+
+	private:
+		llvm::Function* m_function;
+		llvm::BasicBlock* m_callerBlock; // where the top-level code carries on
+		llvm::BasicBlock* m_exitBlock;
+		llvm::Value* m_retval;           // the variable named after a Function
+		llvm::Value* m_result;           // the hidden result of a String Function
+	};
+
+	// a variable declared with Dim
+	struct symbol
+	{
+		int typeId;            // BASIC type (token)
+		llvm::Type* type;      // the type of the value stored in the variable
+		llvm::Value* storage;  // AllocaInst, or GlobalVariable in incremental mode
+		// arrays: the storage holds the pointer to the elements,
+		// and type is the pointer type
+		bool isArray = false;
+		bool isFixed = false;            // on the stack, can't be ReDim'd
+		llvm::MDNode* scope = nullptr;   // alias scope of the elements
+		// the !alias.scope and !noalias lists of the elements,
+		// built once when the array is Dim'd
+		llvm::MDNode* aliasScopes = nullptr;
+		llvm::MDNode* noalias = nullptr;
+		// the variable holding the number of elements, for the index
+		// check of a dynamic array, and to release the elements of a
+		// String array before they are replaced or on exit
+		llvm::Value* count = nullptr;
+		uint64_t fixedCount = 0;         // the number of elements, if isFixed
+	};
+
+	// Case-insensitive, scoped symbol table.
+	// The first scope is the module (global) scope, Sub/Function
+	// bodies push their own scope on top of it.
+	class symbol_table
+	{
+	public:
+		symbol_table();
+
+		void push_scope();
+		void pop_scope();
+		size_t depth() const { return m_scopes.size(); }
+
+		// insert into the innermost scope,
+		// returns nullptr if the name is already there
+		symbol* insert(const char* pszName, const symbol& sym);
+		// lookup from the innermost scope to the scope of the current
+		// procedure, or the global scope in the main program
+		symbol* lookup(const char* pszName);
+		// lookup only the innermost scope
+		symbol* lookup_local(const char* pszName);
+		// lookup only the module scope, where the procedures are
+		symbol* lookup_global(const char* pszName);
+
+		// the storage of the globals belongs to a module that
+		// was handed over to the JIT, it must be declared again.
+		void forget_globals();
+		// remove the globals inserted since forget_globals(),
+		// their statement failed and was never run
+		void drop_new_globals();
+
+	private:
+		std::vector<llvm::StringMap<symbol>> m_scopes;
+		std::vector<std::string> m_newGlobals;
+	};
+
+	class interpreter
 	{
 	public:
 		interpreter(const char* src);
 		~interpreter();
 
+		// the context of every module we build. It is owned by a
+		// ThreadSafeContext, which the JIT shares when it takes a module.
+		operator llvm::LLVMContext&()
+		{ return *m_context.getContext(); }
+		// back from a context of ours (the ir_builder inserter)
+		static interpreter& from_context(llvm::LLVMContext& ctx)
+		{ return *static_cast<interpreter*>(ctx.getDiagnosticContext()); }
+
 		std::unique_ptr<llvm::Module>& get_module()
 		{ return *(std::unique_ptr<llvm::Module>*)&module; }
 		llvm::BasicBlock* get_entry()
@@ -161,23 +444,196 @@ namespace basic
 
 		void print_module(std::string& buffer);
 		void print_version(std::ostream& os);
+		// BASIC_INTERPRETER_VERSION, part of the compile cache key
+		static int get_version();
+		// the settings the generated code depends on, for the cache key
+		std::string get_cache_config() const;
+		// parse one line of a session, returns 0 if it had no errors
 		int eval(const std::string& strCode);
+		// parse a whole source file in one go (batch mode),
+		// returns 0 if there were no errors.
+		int eval_file(const char* pszPath);
+
+		// Identifiers from the lexer are interned here, the strings
+		// stay valid (and unique) as long as the interpreter lives.
+		const char* intern(const char* psz, size_t len)
+		{ return m_strings.save(llvm::StringRef(psz, len)).data(); }
+
+		// Allocate a statement node or a parser temporary,
+		// owned by the interpreter until the top-level statement is done.
+		template <typename T, typename... Args>
+		T* create(Args&&... args)
+		{ return m_nodes.create<T>(std::forward<Args>(args)...); }
+
+		// called by the parser after each top-level line,
+		// releases the nodes once no block is open anymore.
+		void end_of_statement();
+
+		// --time-report and --stats
+		compile_stats& get_stats() { return m_stats; }
+		// time every token, only for the time report
+		void set_lexer_timing(bool bEnable) { m_lexerTiming = bEnable; }
+		bool is_lexer_timing() const { return m_lexerTiming; }
+		// the reentrant flex scanner (yyscan_t) of this interpreter
+		void* get_scanner() { return m_scanner; }
+
+		// used by the parser on error recovery
+		void add_error() { m_errorCount++; }
+		int get_error_count() const { return m_errorCount; }
+
+		// -O0 .. -O3, the default is 0 (no optimization)
+		void set_opt_level(int nLevel);
+		int get_opt_level() const { return m_optLevel; }
+		// verify the module, then run the optimization pipeline
+		// selected by set_opt_level(). Returns false if the module is broken.
+		bool optimize();
+		// PGO, from -O1: instrument the code, the executable writes its
+		// counters to strPath (a .profraw), or optimize with the weights
+		// of a .profdata merged from such runs
+		void set_profile_generate(const std::string& strPath);
+		void set_profile_use(const std::string& strPath);
+
+		// Target CPU for the native code, "native" means the host CPU
+		// and all of its features (like -march=native).
+		// The default is "generic".
+		void set_cpu(const std::string& strCpu);
+
+		// ahead-of-time backend: the native object, in memory,
+		// written out or linked by the caller (and the compile cache)
+		bool emit_object(llvm::SmallVectorImpl<char>& buffer);
+		// the module as bitcode, and back: load_bitcode() replaces the
+		// module with one from the compile cache, nothing is parsed
+		void write_bitcode(llvm::SmallVectorImpl<char>& buffer);
+		bool load_bitcode(llvm::MemoryBufferRef buffer);
+
+		// --library: the Subs and Functions are external and there is
+		// no main(), the bitcode can be used with load_library()
+		void set_library(bool bLibrary);
+		// read the procedures of a precompiled library, before parsing,
+		// the bodies stay in the bitcode until link_libraries()
+		bool load_library(const char* pszPath);
+		// link in the procedures the module calls, after quit()
+		bool link_libraries();
+		// link an object file into an executable with the system linker,
+		// bProfile adds the profile runtime (this needs CC=clang)
+		static bool link_executable(const char* pszObject, const char* pszPath, bool bProfile = false);
+
+		// JIT compile main() and execute it in-process.
+		// The module is handed over to the JIT, so print it first.
+		// Returns 0 on success.
+		int run();
+		// execute main() from a native object instead, in the JIT
+		int run_object(std::unique_ptr<llvm::MemoryBuffer> obj);
+
+		// Incremental mode: every complete top-level statement
+		// is compiled into its own module and executed right away,
+		// Dim'd variables become globals living in the JIT.
+		void set_incremental(bool bIncremental);
+		bool is_incremental() const { return m_incremental; }
+		// true when there is no open For/If block
+		bool is_statement_complete() const { return m_statementList.empty(); }
+		// JIT and execute the pending statement, if it is complete.
+		// Returns 0 on success, or when there is nothing to run yet.
+		int run_statement();
+		// throw away the pending statement after a syntax error, with
+		// the block or the Sub it was part of, nothing of it is run
+		void discard_statement();
+
+		// time spent in the last run(), in milliseconds
+		double get_compile_time() const { return m_compileTime; }
+		double get_execute_time() const { return m_executeTime; }
 
 		// BASIC TypeID to llvm::Type
 		llvm::Type* get_llvm_type(int nType);
 		llvm::Value* get_variable(llvm::BasicBlock* bb, const char* pszVarName);
 
+		// Sub/Function: the function is created in the current module,
+		// internal and fastcc so the optimizer may inline it, or external
+		// in incremental mode, where the later statements call it from
+		// their own modules. Returns null if the name is already taken.
+		llvm::Function* create_procedure(int tok, const char* pszname, llvm::FunctionType* ft);
+		// the body goes into fn, with its own scope, until leave_procedure()
+		void enter_procedure(llvm::Function* fn);
+		// release the heap arrays and Strings of the body, on its exit path
+		void leave_procedure(ir_builder& builder);
+		// call a procedure, or an external function like puts
+		llvm::Value* make_call(const char* pszname, const value_list& args);
+
 		// Constant Values
 		llvm::Constant* get_constant_long(long nValue);
 		llvm::Constant* get_constant_double(double d);
 
 		llvm::Value* find_variable(const char* pszname);
+		// Create the storage for a new variable in the current scope,
+		// an alloca in bb, or a global in incremental mode.
+		// If the name already exists in this scope, that one is returned.
+		llvm::Value* create_variable(int nType, const char* pszname, llvm::BasicBlock* bb);
+
+		// scopes for the procedure bodies
+		void push_scope() { m_symbols.push_scope(); }
+		void pop_scope() { m_symbols.pop_scope(); }
+
+		// a variable is either an AllocaInst or a non-constant GlobalVariable,
+		// or an array element, but not the array itself
+		bool is_variable(llvm::Value* pVal);
+		// the type of the value stored in the variable
+		llvm::Type* get_variable_type(llvm::Value* pVar);
 		llvm::Constant* find_function(const char* pszname);
 
+		// Arrays have contiguous, 32 bytes aligned storage: on the stack
+		// when the size is a small constant, on the heap otherwise.
+		// pSize is the upper bound (elements 0 to pSize), null for Dim a().
+		llvm::Value* create_array(int nType, const char* pszname, llvm::Value* pSize, llvm::BasicBlock* bb);
+		// ReDim a(n), the previous elements are released
+		bool redim_array(const char* pszname, llvm::Value* pSize);
+		bool is_array(llvm::Value* pVal) { return m_arrays.count(pVal) != 0; }
+		// a(i), the result can be used like a variable
+		llvm::Value* make_element_ref(const char* pszname, llvm::Value* pIndex);
+		// attach the alias scopes to the loads and stores of variables,
+		// called by the IRBuilder inserter
+		void annotate_access(llvm::Instruction* I);
+
+		// Strings are always handled through a pointer to a basic_string
+		// (runtime.h), literals are constant globals borrowing their text
+		bool is_string(llvm::Value* pVal);
+		llvm::Constant* make_string_literal(llvm::StringRef text);
+		// a & b, into a new temporary
+		llvm::Value* make_concat(llvm::Value* lhs, llvm::Value* rhs);
+		llvm::Value* make_string_compare(llvm::Value* lhs, llvm::Value* rhs, llvm::CmpInst::Predicate pred);
+		// s = x, through the runtime, s = s & x appends in place
+		llvm::Value* assign_string(llvm::Value* pVar, llvm::Value* pVal);
+		// a temporary in the entry block, released on exit
+		llvm::Value* make_string_temp();
+		// the NUL-terminated characters, for the C functions
+		llvm::Value* string_data(llvm::Value* pStr, ir_builder& builder);
+		llvm::Value* string_length(llvm::Value* pStr, ir_builder& builder);
+		// Len, Mid$, Left$ and InStr
+		bool is_builtin(const char* pszname);
+		llvm::Value* make_builtin(const char* pszname, const value_list& args);
+		// call a runtime function, declared from the types of the arguments
+		llvm::Value* call_runtime(ir_builder& builder, const char* pszname, llvm::Type* retType, llvm::ArrayRef<llvm::Value*> args);
+
+		// Print, one item or separator at a time,
+		// returns false if the value cannot be printed
+		bool print_value(llvm::Value* pVal);
+		void print_char(char c);
+
+		// For loops are tagged so the loop vectorizer picks them up,
+		// or with a width of 1 when vectorization is turned off
+		void set_vectorize(bool bEnable) { m_vectorize = bEnable; }
+		// the floating-point sums of a loop may be reordered (--fast-math)
+		void set_fast_math(bool bEnable) { m_fastMath = bEnable; }
+		bool get_fast_math() const { return m_fastMath; }
+		// bForce: a For loop over array elements without Exit For nor
+		// calls, the vectorizer is asked to vectorize it, the others are
+		// left to the cost model
+		llvm::MDNode* make_loop_metadata(bool bForce);
+		// a pointer to an array element, from make_element_ref()
+		bool is_element(llvm::Value* ptr) const { return m_elements.count(ptr) != 0; }
+
 		llvm::BasicBlock* get_current_block();
 		void set_current_block(llvm::BasicBlock* bb);
 
-		llvm::Value* make_return_value(llvm::Constant* fn, llvm::Value* pVal);
 		llvm::Value* make_equal_comparison(llvm::Value* lhs, llvm::Value* rhs);
 		llvm::Value* assign_variable(llvm::Value* pVar, llvm::Value* pVal);
 
@@ -188,8 +644,39 @@ namespace basic
 		llvm::Value* make_divide(llvm::Value* lhs, llvm::Value* rhs);
 		llvm::Value* make_compare_less_than(llvm::Value* lhs, llvm::Value* rhs);
 		llvm::Value* make_compare_greater_than(llvm::Value* lhs, llvm::Value* rhs);
+		// =, <>, <, <=, > and >= on numbers or Strings, pred is the
+		// signed integer one, it is adapted to the operand types
+		llvm::Value* make_comparison(llvm::Value* lhs, llvm::Value* rhs, llvm::CmpInst::Predicate pred);
+		// And, Or, Xor and Not are bitwise, on the integers
+		llvm::Value* make_logical(llvm::Instruction::BinaryOps op, llvm::Value* lhs, llvm::Value* rhs);
+		llvm::Value* make_not(llvm::Value* pVal);
+		// any value to i1, true when it is not zero
+		llvm::Value* make_condition(llvm::Value* pVal, ir_builder& builder);
+		// AndAlso/OrElse: begin after the left operand, the right one is
+		// built in a block of its own, end merges them. A right operand
+		// that is cheap and safe to evaluate anyway becomes a select.
+		short_circuit* begin_short_circuit(llvm::Value* lhs, bool bAndAlso);
+		llvm::Value* end_short_circuit(short_circuit* sc, llvm::Value* rhs);
+		// the end of a source line closes the single-line Ifs
+		void end_of_line();
 		llvm::Value* make_pow(llvm::Value* lhs, llvm::Value* rhs);
 
+		// the identities of op on the already cast operands (x + 0, x * 1, ...),
+		// and ^ without pow() where possible, null if there is nothing to fold
+		llvm::Value* fold_binary(llvm::Instruction::BinaryOps op, llvm::Value* p1, llvm::Value* p2);
+		llvm::Value* fold_pow(llvm::Value* lhs, llvm::Value* rhs);
+		void set_folding(bool bEnable) { m_fold = bEnable; }
+
+		// Integer/Long add, subtract and multiply, through the
+		// with.overflow intrinsics and a cold error path when
+		// --checked-arith is on. This may start a new current block.
+		llvm::Value* make_int_arith(llvm::Instruction::BinaryOps op, llvm::Value* p1, llvm::Value* p2);
+		// branch to a cold block calling the runtime error function
+		// pszError when pFailed is true, the builder and the current
+		// block continue in a new block
+		void make_error_check(ir_builder& builder, llvm::Value* pFailed, const char* pszError);
+		void set_checked_arith(bool bEnable) { m_checkedArith = bEnable; }
+
 		// Utilities to cast values
 		std::tuple<llvm::Value*, llvm::Value*> cast_as_needed(llvm::Value* lhs, llvm::Value* rhs);
 		llvm::Value* cast_for_assignment(llvm::Value* pVal, llvm::Type* pType);
@@ -204,14 +691,109 @@ namespace basic
 		// find the last for_stmt context
 		// it may not be teh same ID, or may not be found either
 		for_stmt* find_last_for(const char* strId);
+		// the innermost context, if it is an If, ElseIf or Else
+		if_stmt* last_if();
+		// Exit For/Do (bExit) or Continue For/Do of the innermost
+		// loop of that kind, false if there is none
+		bool make_loop_jump(int tok, bool bExit);
+		// the innermost context, if it is a Select Case
+		select_stmt* last_select();
+		// the innermost context, if it is a Do loop
+		do_stmt* last_do();
+		// the Sub/Function being defined, if any
+		sub_stmt* find_last_sub();
 
 	private:
+		static void init_native_target();
+		// the host TargetMachine, created on first use
+		llvm::TargetMachine* get_target_machine();
+		// created on first use by run()
+		llvm::orc::LLJIT* get_jit();
+		// hand the module over to the JIT and return the address of fnName
+		void* jit_compile(const char* fnName);
+		// call main() (bMain) or a statement at pfn, timed. A runtime
+		// error comes back here as -1, instead of ending the process.
+		int execute(void* pfn, bool bMain);
+		// the object file emitter behind emit_object()
+		bool emit_object(llvm::raw_pwrite_stream& dest);
+
+		void create_module(const std::string& modname, const char* fnName);
+		// any value to a signed i64, for the array sizes and indexes
+		llvm::Value* make_index(llvm::Value* pVal, ir_builder& builder);
+		// allocate (n + 1) elements on the heap into the array storage
+		void allocate_array(symbol* sym, llvm::Value* pSize, ir_builder& builder);
+		// basic_str_free each element of a String array, before pElems is replaced
+		void free_string_elements(symbol* sym, llvm::Value* pElems, ir_builder& builder);
+		// release the heap arrays and the Strings of the current function
+		void free_locals(ir_builder& builder);
+		// yyparse() over the current scanner buffer, timed
+		int parse();
+		void next_chunk();
+
+		// declared first, so it goes after everything made in it
+		llvm::orc::ThreadSafeContext m_context;
 		std::unique_ptr<llvm::Module> module;
 		llvm::BasicBlock* m_entryBlock;
 		llvm::BasicBlock* m_exitBlock;
 		std::list<llvm::Function*> m_functions;
 		llvm::BasicBlock* m_activeBlock;
 		std::list<statement*> m_statementList;
+		std::unique_ptr<llvm::orc::LLJIT> m_jit;
+		std::unique_ptr<llvm::TargetMachine> m_target;
+		std::string m_cpu;
+		std::string m_features;
+		int m_optLevel;
+		int m_errorCount;
+		std::string m_modName;
+		bool m_incremental;
+		int m_chunkCount;
+		symbol_table m_symbols;
+		// the storage of the arrays, and the element references
+		// made by make_element_ref() with the alias lists of the array
+		llvm::SmallPtrSet<llvm::Value*, 8> m_arrays;
+		llvm::DenseMap<llvm::Value*, std::pair<llvm::MDNode*, llvm::MDNode*>> m_elements;
+		std::vector<llvm::MDNode*> m_arrayScopes;
+		llvm::MDNode* m_aliasDomain;
+		llvm::MDNode* m_variableScope;
+		llvm::MDNode* m_variableScopes;  // the list of just m_variableScope
+		// heap arrays to release when main() returns,
+		// or the procedure being defined
+		std::vector<llvm::Value*> m_heapArrays;
+		std::vector<llvm::Value*> m_mainHeapArrays;
+		// the String arrays, storage and count, their elements are
+		// released on exit whether the array is on the stack or not
+		std::vector<std::pair<llvm::Value*, llvm::Value*>> m_stringArrays;
+		std::vector<std::pair<llvm::Value*, llvm::Value*>> m_mainStringArrays;
+		// the basic_string struct, the literals of the current module,
+		// and the String variables and temporaries to release on exit
+		llvm::StructType* m_stringType;
+		llvm::StringMap<llvm::GlobalVariable*> m_literals;
+		// the module calls the Print runtime, flush it on exit
+		bool m_printUsed;
+		llvm::SmallPtrSet<llvm::Value*, 8> m_stringTemps;
+		std::vector<llvm::Value*> m_stringSlots;
+		std::vector<llvm::Value*> m_mainStringSlots;
+		bool m_vectorize;
+		bool m_fastMath;
+		bool m_fold;
+		bool m_checkedArith;
+		bool m_library;
+		std::string m_profileGenerate;
+		std::string m_profileUse;
+		// the lazily loaded libraries, and the bitcode they read from
+		std::vector<std::unique_ptr<llvm::Module>> m_libraries;
+		std::vector<std::unique_ptr<llvm::MemoryBuffer>> m_libraryBuffers;
+		std::string m_libraryKey;
+		// the blocks reporting a runtime error, one per function and error
+		std::map<std::pair<llvm::Function*, std::string>, llvm::BasicBlock*> m_errorBlocks;
+		llvm::BumpPtrAllocator m_stringArena;
+		llvm::UniqueStringSaver m_strings{m_stringArena};
+		node_arena m_nodes;
+		compile_stats m_stats;
+		bool m_lexerTiming;
+		void* m_scanner;
+		double m_compileTime;
+		double m_executeTime;
 	};
 }
 
@@ -221,11 +803,16 @@ typedef union basic_parser_types
 	char* identifier;
 	llvm::Value* llvmValue;
 	llvm::Constant* llvmConstant;
-	std::list<std::tuple<std::string, llvm::Type*>>* llvmTypeList;
-	std::vector<llvm::Value*>* llvmValueList;
+	basic::param_list* paramList;
+	basic::value_list* llvmValueList;
 	basic::dim_stmt* dim;
 	basic::if_stmt* ifStmt;
 	basic::for_stmt* forStmt;
+	basic::sub_stmt* subStmt;
+	basic::select_stmt* selectStmt;
+	basic::do_stmt* doStmt;
+	basic::case_list* caseList;
+	basic::short_circuit* shortCircuit;
 } basic_parser_types;
 
 #endif /* BASIC_COMMON_H */
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Cold and warm start latency with --cache: the first run compiles and
+# fills an empty cache, the next ones find the object (or the bitcode)
+# and skip the front end, the optimizer and the backend.
+
+. "$(dirname "$0")/common.sh"
+RUNS=${RUNS:-5}
+
+for emit in obj ll
+do
+	for script in fib saxpy print
+	do
+		rm -rf "$WORK/cache"
+		start=$(now)
+		$BASIC -O2 --emit=$emit --cache="$WORK/cache" "$DIR/$script.bas" -o "$WORK/out" || exit 1
+		cold=$((($(now) - start) / 1000))
+
+		start=$(now)
+		i=0
+		while [ $i -lt $RUNS ]
+		do
+			$BASIC -O2 --emit=$emit --cache="$WORK/cache" "$DIR/$script.bas" -o "$WORK/out"
+			i=$((i + 1))
+		done
+		warm=$((($(now) - start) / 1000 / RUNS))
+		printf '%-4s %-8s cold %8d us   warm %8d us\n' $emit $script $cold $warm
+	done
+done
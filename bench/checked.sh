@@ -0,0 +1,18 @@
+#!/bin/sh
+# Integer loops with and without --checked-arith, the overflow
+# checks should stay within a few percent.
+
+. "$(dirname "$0")/common.sh"
+
+for bench in intsum fib
+do
+	for mode in wrapping checked
+	do
+		flags=""
+		if [ $mode = checked ]; then
+			flags="--checked-arith"
+		fi
+		printf '%-8s %-10s' $bench $mode
+		time_report -O2 $flags "$DIR/$bench.bas" || exit 1
+	done
+done
@@ -0,0 +1,49 @@
+# Sourced by the bench scripts:
+#
+#   . "$(dirname "$0")/common.sh"
+#
+# BASIC is the interpreter to measure, DIR the bench directory, and
+# WORK a scratch directory removed on exit.
+
+BASIC=${BASIC:-./basic}
+DIR=$(dirname "$0")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# nanoseconds, for the wall time of what the reports don't cover
+now()
+{
+	date +%s%N
+}
+
+# compile and run a program in batch mode, and print its
+# --time-report=json line. The errors go to stderr on a failure.
+#   time_report -O2 [flags] file.bas
+time_report()
+{
+	$BASIC "$@" --run --time-report=json -o "$WORK/out.ll" 2>"$WORK/report" >/dev/null
+	if ! grep time_report "$WORK/report"
+	then
+		cat "$WORK/report" >&2
+		return 1
+	fi
+}
+
+# the same for a session: the file is fed to -i, its variables are
+# globals living in the JIT, so the optimizer can't drop the work
+#   session_report -O2 [flags] < file.bas
+session_report()
+{
+	$BASIC "$@" -i --time-report=json 2>"$WORK/report" >/dev/null
+	if ! grep time_report "$WORK/report"
+	then
+		cat "$WORK/report" >&2
+		return 1
+	fi
+}
+
+# the phase times of --time-report=json lines on stdin, as "name value" lines
+phases()
+{
+	grep time_report | tr -d '{}"' | sed 's/time_report: //' | tr ',' '\n' | sed 's/^ *//; s/://'
+}
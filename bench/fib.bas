@@ -0,0 +1,9 @@
+Function Fib(n As Long) As Long
+Fib = n
+If n > 1 Then
+Fib = Fib(n - 1) + Fib(n - 2)
+End If
+End Function
+Dim r As Long
+r = Fib(30)
+Print r
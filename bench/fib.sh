@@ -0,0 +1,13 @@
+#!/bin/sh
+# Recursive Fib(30) under the JIT, at each optimization level.
+#
+# Incremental mode keeps r in a global, so the call can't be
+# optimized away.
+
+. "$(dirname "$0")/common.sh"
+
+for level in 0 1 2 3
+do
+	printf 'fib -O%s  ' $level
+	session_report -O$level < "$DIR/fib.bas" || exit 1
+done
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Instructions emitted at -O0 for the scripts in bench/fold,
+# with and without the folding done by the expression builders.
+
+. "$(dirname "$0")/common.sh"
+
+for script in "$DIR"/fold/*.bas
+do
+	for mode in folded unfolded
+	do
+		flags=""
+		if [ $mode = unfolded ]; then
+			flags="--no-fold"
+		fi
+		printf '%-12s %-10s' "$(basename "$script" .bas)" $mode
+		$BASIC -O0 $flags --stats=json "$script" -o "$WORK/out.ll" 2>&1 >/dev/null \
+			| grep stats
+	done
+done
@@ -0,0 +1,6 @@
+Dim x As Double
+Dim n As Long
+n = 60 * 60 * 24
+x = 3.5 * 2 + 1 / 4
+n = n + 2 * 3
+x = x * (2.0 ^ 3)
@@ -0,0 +1,12 @@
+Dim x As Double
+Dim n As Long
+x = 2.5
+n = 10
+x = x * 1 + 0
+x = x / 2
+x = x / 1
+x = x - 0
+n = n * 1
+n = n + 0
+n = n * 0 + n
+n = n / 1
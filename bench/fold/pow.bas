@@ -0,0 +1,15 @@
+Dim x As Double
+Dim n As Long
+Dim k As Long
+Dim y As Double
+x = 1.5
+n = 7
+k = 3
+y = x ^ 2
+y = x ^ 3 + x ^ 4
+y = 1 / x ^ 2
+n = n ^ 2
+n = n ^ 10
+n = n ^ k
+n = 2 ^ 10
+y = 2 ^ 0.5
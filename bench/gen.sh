@@ -0,0 +1,82 @@
+#!/bin/sh
+# Synthetic programs for bench/run.sh, written to stdout:
+#
+#   gen.sh nested <n>   n blocks of 6 nested For loops, 3 iterations each
+#   gen.sh elseif <n>   an If/ElseIf chain of n arms (a power of 2), in a loop
+#   gen.sh dims <n>     n Dim'd variables, assigned and summed
+#   gen.sh expr <n>     n assignments of a 64-term arithmetic expression
+#
+# They all Print a result, so the optimizer can't drop the work.
+
+kind=$1
+size=${2:-1000}
+
+case $kind in
+nested)
+	awk -v n="$size" 'BEGIN {
+		print "Dim s As Long"
+		for (d = 1; d <= 6; d++)
+			printf "Dim i%d As Long\n", d
+		for (b = 1; b <= n; b++) {
+			for (d = 1; d <= 6; d++)
+				printf "For i%d = 1 To 3\n", d
+			printf "s = s + i1 * i2 - i3 + i4 * i5 - i6 + %d\n", b
+			for (d = 6; d >= 1; d--)
+				printf "Next i%d\n", d
+		}
+		print "Print s"
+	}'
+	;;
+elseif)
+	awk -v n="$size" 'BEGIN {
+		print "Dim s As Long, k As Long, i As Long"
+		print "For i = 1 To 1000000"
+		printf "k = (i * 7919) And %d\n", n - 1
+		print "If k = 0 Then"
+		print "s = s + 1"
+		for (a = 1; a < n; a++) {
+			printf "ElseIf k = %d Then\n", a
+			printf "s = s + %d\n", a % 17
+		}
+		print "Else"
+		print "s = s - 1"
+		print "End If"
+		print "Next i"
+		print "Print s"
+	}'
+	;;
+dims)
+	awk -v n="$size" 'BEGIN {
+		print "Dim s As Long"
+		for (v = 1; v <= n; v++) {
+			printf "Dim v%d As Long\n", v
+			printf "v%d = %d\n", v, v
+		}
+		for (v = 1; v <= n; v++)
+			printf "s = s + v%d\n", v
+		print "Print s"
+	}'
+	;;
+expr)
+	awk -v n="$size" 'BEGIN {
+		print "Dim a As Double, b As Double, c As Double, x As Double"
+		print "a = 1.5"
+		print "b = 2.25"
+		print "c = 0.75"
+		split("+ - * +", ops, " ")
+		split("a b c x", vars, " ")
+		for (l = 1; l <= n; l++) {
+			line = "x = a"
+			for (t = 1; t < 64; t++)
+				line = line " " ops[(t + l) % 4 + 1] " " (t % 5 == 0 ? "(" vars[t % 4 + 1] " - " t ")" : vars[(t * l) % 4 + 1])
+			print line
+			print "x = x / 1000"
+		}
+		print "Print x"
+	}'
+	;;
+*)
+	echo "usage: $0 nested|elseif|dims|expr [size]" >&2
+	exit 1
+	;;
+esac
@@ -0,0 +1,6 @@
+Dim s As Long
+Dim i As Long
+For i = 1 To 100000000
+s = s + i * 3 - 1
+Next i
+Print s
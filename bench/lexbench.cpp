@@ -0,0 +1,99 @@
+#include "../basic.h"
+#include "../parser.hpp"
+#include <chrono>
+#include <cstdlib>
+
+/////////////////////////////////////////////////////////////////////////
+// Lexer micro-benchmark
+//
+// Tokenizes a large generated program and reports tokens/sec.
+// usage: lexbench [lines] [runs]
+/////////////////////////////////////////////////////////////////////////
+
+// the reentrant scanner, see lexer.l
+typedef void* yyscan_t;
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern int basic_lex(basic_parser_types* lval, yyscan_t scanner);
+extern int yylex_init_extra(basic::interpreter* pInterp, yyscan_t* scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern YY_BUFFER_STATE yy_scan_string(const char* strBuff, yyscan_t scanner);
+extern void yy_delete_buffer(YY_BUFFER_STATE pbuff, yyscan_t scanner);
+
+// mostly identifiers, which is what real programs look like
+static std::string generate(int nLines)
+{
+	std::string src;
+	src.reserve(nLines * 32);
+	for (int i = 0; i < nLines; i++)
+	{
+		std::string var = "value_" + std::to_string(i % 97);
+		switch (i % 6)
+		{
+		case 0:
+			src += "Dim " + var + " As Integer, total_" + std::to_string(i % 13) + " As Double\n";
+			break;
+		case 1:
+			src += var + " = " + var + " + counter * 42 - 3.25\n";
+			break;
+		case 2:
+			src += "If " + var + " > limit Then\n";
+			break;
+		case 3:
+			src += "puts \"the quick brown fox\"\n";
+			break;
+		case 4:
+			src += "For " + var + " = 0 To 100 Step 2\n";
+			break;
+		default:
+			src += "Next " + var + "\nEnd If\n";
+			break;
+		}
+	}
+	return src;
+}
+
+int main(int argc, char** argv)
+{
+	int nLines = argc > 1 ? atoi(argv[1]) : 200000;
+	int nRuns = argc > 2 ? atoi(argv[2]) : 5;
+	if (nLines <= 0 || nRuns <= 0)
+	{
+		std::cerr << "usage: " << argv[0] << " [lines] [runs]\n";
+		return 1;
+	}
+
+	basic::interpreter bi("lexbench");
+	std::string src = generate(nLines);
+	// a scanner of our own, the interpreter's belongs to its parser
+	yyscan_t scanner = nullptr;
+	yylex_init_extra(&bi, &scanner);
+
+	double best = 0.0;
+	long nTokens = 0;
+	for (int run = 0; run < nRuns; run++)
+	{
+		basic_parser_types lval;
+		nTokens = 0;
+
+		auto t0 = std::chrono::steady_clock::now();
+		YY_BUFFER_STATE state = yy_scan_string(src.c_str(), scanner);
+		while (basic_lex(&lval, scanner) != 0)
+			nTokens++;
+		yy_delete_buffer(state, scanner);
+		auto t1 = std::chrono::steady_clock::now();
+
+		double elapsed = std::chrono::duration<double>(t1 - t0).count();
+		if (run == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	yylex_destroy(scanner);
+
+	std::cout << "lines: " << nLines
+		<< ", bytes: " << src.size()
+		<< ", tokens: " << nTokens << "\n"
+		<< "best of " << nRuns << ": " << best * 1000.0 << " ms, "
+		<< static_cast<long>(nTokens / best) << " tokens/sec, "
+		<< (src.size() / best) / (1024.0 * 1024.0) << " MB/sec\n";
+	return 0;
+}
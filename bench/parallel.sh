@@ -0,0 +1,32 @@
+#!/bin/sh
+# Compiles the same batch of small scripts with -j 1 up to the number of
+# cores, every file with its own interpreter on a thread of the pool.
+# The wall time should go down close to linearly until the cores or the
+# memory bandwidth run out. FILES=n sets the size of the batch.
+
+. "$(dirname "$0")/common.sh"
+FILES=${FILES:-200}
+CORES=$(nproc 2>/dev/null || echo 4)
+
+i=0
+while [ $i -lt $FILES ]
+do
+	for src in fib saxpy intsum reduce
+	do
+		cp "$DIR/$src.bas" "$WORK/$src-$i.bas"
+	done
+	i=$((i + 1))
+done
+
+j=1
+while [ $j -le $CORES ]
+do
+	start=$(now)
+	$BASIC -O2 -j $j "$WORK"/*.bas || exit 1
+	printf -- '-j %-3d %6d ms\n' $j $((($(now) - start) / 1000000))
+	j=$((j * 2))
+	if [ $j -gt $CORES ] && [ $((j / 2)) -lt $CORES ]
+	then
+		j=$CORES
+	fi
+done
@@ -0,0 +1,20 @@
+Dim i As Long, x As Long, k As Long, s As Long
+x = 12345
+For i = 1 To 100000000
+x = (x * 1103515245 + 12345) And 2147483647
+k = x And 1023
+If k < 8 Then
+s = s + 1
+ElseIf k < 16 Then
+s = s - 3
+ElseIf k < 32 Then
+s = s Xor k
+ElseIf k < 40 Then
+s = s * 3
+ElseIf k < 1000 Then
+s = s + k
+Else
+s = s - k
+End If
+Next i
+Print s
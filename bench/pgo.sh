@@ -0,0 +1,21 @@
+#!/bin/sh
+# test2.bas scaled up: an If/ElseIf chain in a 100M iteration loop,
+# where the arm tested next to last is taken 94% of the time. Built
+# plain, then instrumented, run once for a profile, and rebuilt with
+# it. Needs clang (for the profile runtime) and llvm-profdata.
+
+. "$(dirname "$0")/common.sh"
+PROFDATA=${LLVM_PROFDATA:-llvm-profdata}
+
+$BASIC -O2 --emit=exe "$DIR/pgo.bas" -o "$WORK/plain" || exit 1
+$BASIC -O2 --emit=exe --profile-generate="$WORK/pgo.profraw" "$DIR/pgo.bas" -o "$WORK/instr" || exit 1
+"$WORK/instr" >/dev/null || exit 1
+$PROFDATA merge -o "$WORK/pgo.profdata" "$WORK/pgo.profraw" || exit 1
+$BASIC -O2 --emit=exe --profile-use="$WORK/pgo.profdata" "$DIR/pgo.bas" -o "$WORK/pgo" || exit 1
+
+for build in plain instr pgo
+do
+	start=$(now)
+	"$WORK/$build" >/dev/null
+	printf '%-6s %6d ms\n' $build $((($(now) - start) / 1000000))
+done
@@ -0,0 +1,4 @@
+Dim i As Long
+For i = 1 To 10000000
+Print i
+Next i
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Print 10M numbers from a native executable, against seq(1) writing
+# the same 10M lines, which is about as fast as write(2) gets.
+
+. "$(dirname "$0")/common.sh"
+
+$BASIC -O2 --emit=exe -o "$WORK/print" "$DIR/print.bas" || exit 1
+
+echo "basic Print:"
+time "$WORK/print" > /dev/null
+echo "seq:"
+time seq 10000000 > /dev/null
@@ -0,0 +1,9 @@
+Dim i As Long
+Dim s As Double
+Dim x(9999999) As Double
+For i = 0 To 9999999
+x(i) = i
+Next i
+For i = 0 To 9999999
+s = s + x(i)
+Next i
@@ -0,0 +1,94 @@
+#!/bin/sh
+# The benchmark harness behind make bench.
+#
+# Generates the synthetic programs (bench/gen.sh), then compiles and
+# runs each one RUNS times with --run --time-report=json and reports,
+# per program, the median and the 95th percentile of:
+#
+#   frontend   lex + parse + IR generation, in ms and in lines/sec
+#   optimize   the -O pipeline (verification included)
+#   jit        JIT compilation
+#   execute    the program itself
+#
+# The results also go to $JSON (bench-results.json), one object per
+# program, to keep and compare between builds.
+#
+#   BASIC=./basic RUNS=5 OPT=-O2 JSON=bench-results.json sh bench/run.sh
+
+. "$(dirname "$0")/common.sh"
+RUNS=${RUNS:-5}
+OPT=${OPT:--O2}
+JSON=${JSON:-bench-results.json}
+
+# program and size
+PROGRAMS="nested:400 elseif:1024 dims:5000 expr:1000"
+
+# median and p95 (nearest rank) of the numbers on stdin, as "median p95"
+stats()
+{
+	sort -n | awk '{ v[NR] = $1 }
+		END {
+			if (NR == 0) { print "0 0"; exit }
+			m = NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2
+			r = int(0.95 * NR + 0.999999)
+			printf "%.3f %.3f\n", m, v[r < 1 ? 1 : r]
+		}'
+}
+
+printf '%-8s %7s  %-22s %-22s %-22s %-22s %s\n' program lines \
+	"frontend ms (p95)" "optimize ms (p95)" "jit ms (p95)" "execute ms (p95)" "lines/sec"
+echo "[" > "$JSON"
+first=1
+for entry in $PROGRAMS
+do
+	name=${entry%%:*}
+	size=${entry#*:}
+	src="$WORK/$name.bas"
+	sh "$DIR/gen.sh" $name $size > "$src" || exit 1
+	lines=$(wc -l < "$src")
+
+	: > "$WORK/times"
+	run=0
+	while [ $run -lt $RUNS ]
+	do
+		if ! time_report $OPT "$src" > "$WORK/line"
+		then
+			echo "$name: failed" >&2
+			exit 1
+		fi
+		phases < "$WORK/line" | awk -v run=$run '
+			{ t[$1] = $2 }
+			END {
+				print run, "frontend", t["lex"] + t["parse"]
+				print run, "optimize", t["verify"] + t["optimize"]
+				print run, "jit", t["jit"]
+				print run, "execute", t["execute"]
+			}' >> "$WORK/times"
+		run=$((run + 1))
+	done
+
+	for metric in frontend optimize jit execute
+	do
+		awk -v m=$metric '$2 == m { print $3 }' "$WORK/times" | stats > "$WORK/$metric"
+	done
+	read fe_med fe_p95 < "$WORK/frontend"
+	read opt_med opt_p95 < "$WORK/optimize"
+	read jit_med jit_p95 < "$WORK/jit"
+	read exe_med exe_p95 < "$WORK/execute"
+	lps=$(awk -v l=$lines -v t=$fe_med 'BEGIN { printf "%.0f", (t > 0 ? l * 1000 / t : 0) }')
+
+	printf '%-8s %7d  %9s (%9s)  %9s (%9s)  %9s (%9s)  %9s (%9s)  %s\n' $name $lines \
+		$fe_med $fe_p95 $opt_med $opt_p95 $jit_med $jit_p95 $exe_med $exe_p95 $lps
+
+	[ $first -eq 1 ] || echo "," >> "$JSON"
+	first=0
+	printf '  {"program": "%s", "lines": %d, "runs": %d, "opt": "%s", "lines_per_sec": %s,\n' \
+		$name $lines $RUNS $OPT $lps >> "$JSON"
+	printf '   "frontend_ms": {"median": %s, "p95": %s}, "optimize_ms": {"median": %s, "p95": %s},\n' \
+		$fe_med $fe_p95 $opt_med $opt_p95 >> "$JSON"
+	printf '   "jit_ms": {"median": %s, "p95": %s}, "execute_ms": {"median": %s, "p95": %s}}' \
+		$jit_med $jit_p95 $exe_med $exe_p95 >> "$JSON"
+done
+echo "" >> "$JSON"
+echo "]" >> "$JSON"
+echo "results written to $JSON"
@@ -0,0 +1,10 @@
+Dim i As Long
+Dim a(9999999) As Double
+Dim x(9999999) As Double
+For i = 0 To 9999999
+x(i) = i
+a(i) = 1.5
+Next i
+For i = 0 To 9999999
+a(i) = 2.5 * x(i) + a(i)
+Next i
@@ -0,0 +1,16 @@
+#!/bin/sh
+# A 64-arm dispatcher on pseudo-random values, as Select Case (one
+# switch, a jump table) and as the equivalent If/ElseIf chain (up to
+# 64 compares). At -O2 SimplifyCFG may turn the chain into a switch
+# by itself, -O0 shows what the dispatch costs as written.
+
+. "$(dirname "$0")/common.sh"
+
+for opt in -O0 -O2
+do
+	for bench in switch elseif
+	do
+		printf '%-4s %-8s' $opt $bench
+		time_report $opt "$DIR/select/$bench.bas" || exit 1
+	done
+done
@@ -0,0 +1,135 @@
+Dim x As Long, k As Long, s As Long, i As Long
+For i = 1 To 20000000
+x = x * 1103515245 + 12345
+k = (x / 65536) And 63
+If k = 0 Then
+s = s + 1
+ElseIf k = 1 Then
+s = s - i + 1
+ElseIf k = 2 Then
+s = s * 3 + 2
+ElseIf k = 3 Then
+s = s + x / 4
+ElseIf k = 4 Then
+s = s + 13
+ElseIf k = 5 Then
+s = s - i + 5
+ElseIf k = 6 Then
+s = s * 3 + 6
+ElseIf k = 7 Then
+s = s + x / 8
+ElseIf k = 8 Then
+s = s + 25
+ElseIf k = 9 Then
+s = s - i + 9
+ElseIf k = 10 Then
+s = s * 3 + 10
+ElseIf k = 11 Then
+s = s + x / 12
+ElseIf k = 12 Then
+s = s + 37
+ElseIf k = 13 Then
+s = s - i + 13
+ElseIf k = 14 Then
+s = s * 3 + 14
+ElseIf k = 15 Then
+s = s + x / 16
+ElseIf k = 16 Then
+s = s + 49
+ElseIf k = 17 Then
+s = s - i + 17
+ElseIf k = 18 Then
+s = s * 3 + 18
+ElseIf k = 19 Then
+s = s + x / 20
+ElseIf k = 20 Then
+s = s + 61
+ElseIf k = 21 Then
+s = s - i + 21
+ElseIf k = 22 Then
+s = s * 3 + 22
+ElseIf k = 23 Then
+s = s + x / 24
+ElseIf k = 24 Then
+s = s + 73
+ElseIf k = 25 Then
+s = s - i + 25
+ElseIf k = 26 Then
+s = s * 3 + 26
+ElseIf k = 27 Then
+s = s + x / 28
+ElseIf k = 28 Then
+s = s + 85
+ElseIf k = 29 Then
+s = s - i + 29
+ElseIf k = 30 Then
+s = s * 3 + 30
+ElseIf k = 31 Then
+s = s + x / 32
+ElseIf k = 32 Then
+s = s + 97
+ElseIf k = 33 Then
+s = s - i + 33
+ElseIf k = 34 Then
+s = s * 3 + 34
+ElseIf k = 35 Then
+s = s + x / 36
+ElseIf k = 36 Then
+s = s + 109
+ElseIf k = 37 Then
+s = s - i + 37
+ElseIf k = 38 Then
+s = s * 3 + 38
+ElseIf k = 39 Then
+s = s + x / 40
+ElseIf k = 40 Then
+s = s + 121
+ElseIf k = 41 Then
+s = s - i + 41
+ElseIf k = 42 Then
+s = s * 3 + 42
+ElseIf k = 43 Then
+s = s + x / 44
+ElseIf k = 44 Then
+s = s + 133
+ElseIf k = 45 Then
+s = s - i + 45
+ElseIf k = 46 Then
+s = s * 3 + 46
+ElseIf k = 47 Then
+s = s + x / 48
+ElseIf k = 48 Then
+s = s + 145
+ElseIf k = 49 Then
+s = s - i + 49
+ElseIf k = 50 Then
+s = s * 3 + 50
+ElseIf k = 51 Then
+s = s + x / 52
+ElseIf k = 52 Then
+s = s + 157
+ElseIf k = 53 Then
+s = s - i + 53
+ElseIf k = 54 Then
+s = s * 3 + 54
+ElseIf k = 55 Then
+s = s + x / 56
+ElseIf k = 56 Then
+s = s + 169
+ElseIf k = 57 Then
+s = s - i + 57
+ElseIf k = 58 Then
+s = s * 3 + 58
+ElseIf k = 59 Then
+s = s + x / 60
+ElseIf k = 60 Then
+s = s + 181
+ElseIf k = 61 Then
+s = s - i + 61
+ElseIf k = 62 Then
+s = s * 3 + 62
+ElseIf k = 63 Then
+s = s + x / 64
+End If
+Next i
+Print s
@@ -0,0 +1,136 @@
+Dim x As Long, k As Long, s As Long, i As Long
+For i = 1 To 20000000
+x = x * 1103515245 + 12345
+k = (x / 65536) And 63
+Select Case k
+Case 0
+s = s + 1
+Case 1
+s = s - i + 1
+Case 2
+s = s * 3 + 2
+Case 3
+s = s + x / 4
+Case 4
+s = s + 13
+Case 5
+s = s - i + 5
+Case 6
+s = s * 3 + 6
+Case 7
+s = s + x / 8
+Case 8
+s = s + 25
+Case 9
+s = s - i + 9
+Case 10
+s = s * 3 + 10
+Case 11
+s = s + x / 12
+Case 12
+s = s + 37
+Case 13
+s = s - i + 13
+Case 14
+s = s * 3 + 14
+Case 15
+s = s + x / 16
+Case 16
+s = s + 49
+Case 17
+s = s - i + 17
+Case 18
+s = s * 3 + 18
+Case 19
+s = s + x / 20
+Case 20
+s = s + 61
+Case 21
+s = s - i + 21
+Case 22
+s = s * 3 + 22
+Case 23
+s = s + x / 24
+Case 24
+s = s + 73
+Case 25
+s = s - i + 25
+Case 26
+s = s * 3 + 26
+Case 27
+s = s + x / 28
+Case 28
+s = s + 85
+Case 29
+s = s - i + 29
+Case 30
+s = s * 3 + 30
+Case 31
+s = s + x / 32
+Case 32
+s = s + 97
+Case 33
+s = s - i + 33
+Case 34
+s = s * 3 + 34
+Case 35
+s = s + x / 36
+Case 36
+s = s + 109
+Case 37
+s = s - i + 37
+Case 38
+s = s * 3 + 38
+Case 39
+s = s + x / 40
+Case 40
+s = s + 121
+Case 41
+s = s - i + 41
+Case 42
+s = s * 3 + 42
+Case 43
+s = s + x / 44
+Case 44
+s = s + 133
+Case 45
+s = s - i + 45
+Case 46
+s = s * 3 + 46
+Case 47
+s = s + x / 48
+Case 48
+s = s + 145
+Case 49
+s = s - i + 49
+Case 50
+s = s * 3 + 50
+Case 51
+s = s + x / 52
+Case 52
+s = s + 157
+Case 53
+s = s - i + 53
+Case 54
+s = s * 3 + 54
+Case 55
+s = s + x / 56
+Case 56
+s = s + 169
+Case 57
+s = s - i + 57
+Case 58
+s = s * 3 + 58
+Case 59
+s = s + x / 60
+Case 60
+s = s + 181
+Case 61
+s = s - i + 61
+Case 62
+s = s * 3 + 62
+Case 63
+s = s + x / 64
+End Select
+Next i
+Print s
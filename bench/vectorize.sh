@@ -0,0 +1,22 @@
+#!/bin/sh
+# SAXPY and a sum over 10M doubles, vectorized and scalar.
+#
+# The scripts run in incremental mode, the arrays and variables are
+# globals living in the JIT, so the optimizer can't drop the loops.
+# The execute time covers the whole script, initialization included.
+# The sum is only vectorized when it may be reordered, --fast-math.
+
+. "$(dirname "$0")/common.sh"
+
+for bench in saxpy reduce
+do
+	for mode in vectorized scalar
+	do
+		flags="--fast-math"
+		if [ $mode = scalar ]; then
+			flags="--no-vectorize"
+		fi
+		printf '%-8s %-12s' $bench $mode
+		session_report -O3 -march=native $flags < "$DIR/$bench.bas" || exit 1
+	done
+done
@@ -0,0 +1,232 @@
+#include "basic.h"
+#include "cache.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Config/llvm-config.h>
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace basic;
+using namespace llvm;
+
+// a hash of the compiler sources, set by the Makefile. Without it,
+// every build of cache.cpp counts as another compiler.
+#ifndef BASIC_BUILD_ID
+#define BASIC_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+compile_cache::compile_cache(const std::string& strDir, uint64_t nMaxBytes)
+	: m_dir(strDir), m_maxBytes(nMaxBytes), m_hits(0), m_misses(0),
+	m_stores(0), m_evictions(0), m_tempCount(0)
+{
+	m_ready = !sys::fs::create_directories(m_dir);
+	if (!m_ready)
+		std::cerr << "basic: cannot create the cache directory " << m_dir << "\n";
+}
+
+std::string compile_cache::default_dir()
+{
+	const char* env = getenv("BASIC_CACHE_DIR");
+	if (env && *env)
+		return env;
+	env = getenv("XDG_CACHE_HOME");
+	if (env && *env)
+		return std::string(env) + "/basic";
+	env = getenv("HOME");
+	if (env && *env)
+		return std::string(env) + "/.cache/basic";
+	return ".basic-cache";
+}
+
+std::string compile_cache::make_key(StringRef source, StringRef strConfig)
+{
+	// the LLVM version and the build of the compiler too, the bitcode
+	// and the objects depend on them (and on the runtime they call)
+	SHA1 hash;
+	hash.update(strConfig);
+	hash.update(" llvm " LLVM_VERSION_STRING " build " BASIC_BUILD_ID "\n");
+	hash.update(source);
+	return toHex(hash.final(), true);
+}
+
+std::string compile_cache::get_path(const std::string& strKey, const char* pszExt) const
+{
+	return m_dir + "/" + strKey + pszExt;
+}
+
+std::unique_ptr<MemoryBuffer> compile_cache::lookup(const std::string& strKey, const char* pszExt)
+{
+	if (!m_ready)
+		return nullptr;
+	std::string strPath = get_path(strKey, pszExt);
+	auto buffer = MemoryBuffer::getFile(strPath, -1, false);
+	if (!buffer)
+		return nullptr;
+	// the modification time is the LRU order
+	utimes(strPath.c_str(), nullptr);
+	return std::move(*buffer);
+}
+
+bool compile_cache::store(const std::string& strKey, const char* pszExt, StringRef data)
+{
+	if (!m_ready)
+		return false;
+	std::string strPath = get_path(strKey, pszExt);
+	std::string strTemp = strPath + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(m_tempCount++);
+	{
+		std::error_code ec;
+		raw_fd_ostream os(strTemp, ec, sys::fs::F_None);
+		if (ec)
+			return false;
+		os << data;
+		os.close();
+		if (os.has_error())
+		{
+			os.clear_error();
+			unlink(strTemp.c_str());
+			return false;
+		}
+	}
+	if (rename(strTemp.c_str(), strPath.c_str()) != 0)
+	{
+		unlink(strTemp.c_str());
+		return false;
+	}
+	m_stores++;
+	if (m_maxBytes)
+		evict();
+	return true;
+}
+
+void compile_cache::evict()
+{
+	// one thread at a time, other processes may still race us,
+	// which only costs a failed unlink
+	std::lock_guard<std::mutex> lock(m_evictMutex);
+	DIR* dir = opendir(m_dir.c_str());
+	if (!dir)
+		return;
+
+	struct entry
+	{
+		std::string strPath;
+		uint64_t nSize;
+		struct timespec mtime;
+	};
+	std::vector<entry> entries;
+	uint64_t nTotal = 0;
+	while (struct dirent* de = readdir(dir))
+	{
+		// ours only: <sha1>.bc and <sha1>.o, not the temporaries
+		StringRef name(de->d_name);
+		if (!name.endswith(".bc") && !name.endswith(".o"))
+			continue;
+		std::string strPath = m_dir + "/" + de->d_name;
+		struct stat st;
+		if (stat(strPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		entries.push_back({ strPath, static_cast<uint64_t>(st.st_size), st.st_mtim });
+		nTotal += st.st_size;
+	}
+	closedir(dir);
+	if (nTotal <= m_maxBytes)
+		return;
+
+	std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+		if (a.mtime.tv_sec != b.mtime.tv_sec)
+			return a.mtime.tv_sec < b.mtime.tv_sec;
+		return a.mtime.tv_nsec < b.mtime.tv_nsec;
+	});
+	for (auto& e: entries)
+	{
+		if (nTotal <= m_maxBytes)
+			break;
+		if (unlink(e.strPath.c_str()) == 0)
+			m_evictions++;
+		nTotal -= e.nSize;
+	}
+}
+
+void compile_cache::print_stats(std::ostream& os) const
+{
+	os << "===---------------------------------------------===\n"
+		<< "                 Compile cache\n"
+		<< "===---------------------------------------------===\n"
+		<< std::setw(10) << m_hits << "  hits\n"
+		<< std::setw(10) << m_misses << "  misses\n"
+		<< std::setw(10) << m_stores << "  files stored\n"
+		<< std::setw(10) << m_evictions << "  files evicted\n";
+}
+
+void compile_cache::print_stats_json(std::ostream& os) const
+{
+	os << "{\"cache\": {\"hits\": " << m_hits
+		<< ", \"misses\": " << m_misses
+		<< ", \"stores\": " << m_stores
+		<< ", \"evictions\": " << m_evictions << "}}\n";
+}
+
+/////////////////////////////////////////////////////////////////////////
+// The module as bitcode, for the cache
+/////////////////////////////////////////////////////////////////////////
+
+std::string interpreter::get_cache_config() const
+{
+	std::string strConfig = "basic " + std::to_string(get_version())
+		+ " -O" + std::to_string(m_optLevel)
+		+ " -mcpu=" + m_cpu + " " + m_features;
+	if (!m_vectorize)
+		strConfig += " --no-vectorize";
+	if (m_fastMath)
+		strConfig += " --fast-math";
+	if (!m_fold)
+		strConfig += " --no-fold";
+	if (m_checkedArith)
+		strConfig += " --checked-arith";
+	if (m_library)
+		strConfig += " --library";
+	if (!m_profileGenerate.empty())
+		strConfig += " --profile-generate=" + m_profileGenerate;
+	if (!m_profileUse.empty())
+	{
+		// new counters make a different program
+		auto profile = MemoryBuffer::getFile(m_profileUse);
+		SHA1 hash;
+		if (profile)
+			hash.update((*profile)->getBuffer());
+		strConfig += " --profile-use=" + toHex(hash.final(), true);
+	}
+	return strConfig + m_libraryKey;
+}
+
+void interpreter::write_bitcode(SmallVectorImpl<char>& buffer)
+{
+	if (!module)
+		return;
+	raw_svector_ostream os(buffer);
+	WriteBitcodeToFile(*module, os);
+}
+
+bool interpreter::load_bitcode(MemoryBufferRef buffer)
+{
+	// the statements were never parsed, the whole module is replaced
+	auto m = parseBitcodeFile(buffer, *this);
+	if (!m)
+	{
+		logAllUnhandledErrors(m.takeError(), errs(), "basic: cache: ");
+		return false;
+	}
+	module = std::move(*m);
+	m_entryBlock = m_exitBlock = m_activeBlock = nullptr;
+	return true;
+}
@@ -0,0 +1,66 @@
+#ifndef BASIC_CACHE_H
+#define BASIC_CACHE_H
+
+// Content-addressed compile cache for batch mode (--cache).
+//
+// The key is a SHA-1 over the source text and everything else the
+// output depends on (interpreter, build and LLVM versions, -O level, target
+// CPU, code generation flags). A hit hands back the optimized bitcode
+// (.bc) or the native object (.o) stored by a previous compilation, so
+// the front end, the optimizer and the backend are skipped. The files
+// live in one directory, the least recently used ones are removed when
+// it grows over the size limit.
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace basic
+{
+	class compile_cache
+	{
+	public:
+		// nMaxBytes = 0 means no limit
+		compile_cache(const std::string& strDir, uint64_t nMaxBytes);
+
+		// $BASIC_CACHE_DIR, or basic under the user cache directory
+		static std::string default_dir();
+		// the key of a source, strConfig is everything else that matters
+		static std::string make_key(llvm::StringRef source, llvm::StringRef strConfig);
+
+		// the cached file for the key, pszExt is ".bc" or ".o",
+		// null if there is none. A hit makes it the most recently used.
+		std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string& strKey, const char* pszExt);
+		// written under a temporary name and renamed, so a concurrent
+		// reader (another thread or process) never sees half a file
+		bool store(const std::string& strKey, const char* pszExt, llvm::StringRef data);
+
+		// one per compiled file, whether it could be skipped or not
+		void count_hit() { m_hits++; }
+		void count_miss() { m_misses++; }
+
+		void print_stats(std::ostream& os) const;
+		void print_stats_json(std::ostream& os) const;
+
+	private:
+		std::string get_path(const std::string& strKey, const char* pszExt) const;
+		// remove the oldest files until the directory fits in m_maxBytes
+		void evict();
+
+		std::string m_dir;
+		uint64_t m_maxBytes;
+		bool m_ready;
+		std::mutex m_evictMutex;
+		std::atomic<long> m_hits;
+		std::atomic<long> m_misses;
+		std::atomic<long> m_stores;
+		std::atomic<long> m_evictions;
+		std::atomic<unsigned> m_tempCount;
+	};
+}
+
+#endif /* BASIC_CACHE_H */
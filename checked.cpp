@@ -0,0 +1,80 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Checked arithmetic
+//
+// With --checked-arith, Integer and Long +, - and * go through the
+// llvm.s*.with.overflow intrinsics. An overflow branches to a block
+// that reports it and ends the program, one such block per function.
+// The branch is weighted as never taken and the error function is
+// cold, so the hot path stays a plain add followed by a jo.
+//
+// Without it, the integers wrap around like they always did.
+//
+// The array accesses and allocations are checked the same way,
+// always, see make_element_ref() and allocate_array().
+/////////////////////////////////////////////////////////////////////////
+
+// how unlikely an error is, the same ratio as __builtin_expect
+static const uint32_t ERROR_WEIGHT = 1;
+static const uint32_t NO_ERROR_WEIGHT = 2000;
+
+static Intrinsic::ID overflow_intrinsic(Instruction::BinaryOps op)
+{
+	switch (op)
+	{
+	case Instruction::Add:
+		return Intrinsic::sadd_with_overflow;
+	case Instruction::Sub:
+		return Intrinsic::ssub_with_overflow;
+	default:
+		return Intrinsic::smul_with_overflow;
+	}
+}
+
+void interpreter::make_error_check(ir_builder& builder, Value* pFailed, const char* pszError)
+{
+	Function* f = get_current_function();
+	BasicBlock*& errorBlock = m_errorBlocks[std::make_pair(f, std::string(pszError))];
+	if (!errorBlock)
+	{
+		errorBlock = BasicBlock::Create(*this, "error", f);
+		ir_builder eb(errorBlock);
+		Function* errorFn = static_cast<Function*>(module->getOrInsertFunction(pszError,
+				FunctionType::get(eb.getVoidTy(), false)));
+		errorFn->addFnAttr(Attribute::NoReturn);
+		errorFn->addFnAttr(Attribute::Cold);
+		errorFn->addFnAttr(Attribute::NoUnwind);
+		CallInst* call = eb.CreateCall(errorFn);
+		call->setDoesNotReturn();
+		eb.CreateUnreachable();
+	}
+
+	BasicBlock* next = BasicBlock::Create(*this, "", f);
+	builder.CreateCondBr(pFailed, errorBlock, next,
+			MDBuilder(*this).createBranchWeights(ERROR_WEIGHT, NO_ERROR_WEIGHT));
+	builder.SetInsertPoint(next);
+	m_activeBlock = next;
+}
+
+Value* interpreter::make_int_arith(Instruction::BinaryOps op, Value* p1, Value* p2)
+{
+	ir_builder builder(m_activeBlock);
+	// Boolean and Byte keep wrapping, and the constants are folded
+	if (!m_checkedArith || !is_signed_type(p1->getType())
+			|| (Constant::classof(p1) && Constant::classof(p2)))
+		return builder.CreateBinOp(op, p1, p2);
+
+	Function* intrinsic = Intrinsic::getDeclaration(module.get(), overflow_intrinsic(op), p1->getType());
+	Value* args[] = { p1, p2 };
+	Value* pPair = builder.CreateCall(intrinsic, args);
+	Value* pResult = builder.CreateExtractValue(pPair, 0);
+	make_error_check(builder, builder.CreateExtractValue(pPair, 1), "basic_overflow_error");
+	return pResult;
+}
@@ -0,0 +1,158 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Do loops
+//
+// Do While c          Do
+//     ...                 ...
+// Loop                Loop Until c
+//
+// Both are emitted the way LLVM's loop passes want them after rotation,
+// with the test at the bottom, in the only latch:
+//
+//   parent -> test -> body ... -> latch -> body
+//               |                    |
+//               +-> exit             +-> exit
+//
+// The test after Do is built once, where the parser evaluates it, then
+// its instructions are copied into the latch. A condition spanning
+// several blocks (OrElse with a call, --checked-arith) is not copied,
+// the latch goes back to the test instead, and loop-rotate can still
+// do the rest. Continue jumps to the latch, Exit to the exit block.
+/////////////////////////////////////////////////////////////////////////
+
+do_stmt::do_stmt(interpreter* pInterp, BasicBlock* parent, bool bTest) : statement(pInterp, DO, "Do")
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_DO);
+	Function* f = parent->getParent();
+	m_parentBlock = parent;
+	m_testBlock = bTest ? BasicBlock::Create(*m_interp, "", f) : nullptr;
+	m_testEnd = nullptr;
+	m_testCond = nullptr;
+	m_bodyBlock = BasicBlock::Create(*m_interp, "", f);
+	m_latchBlock = BasicBlock::Create(*m_interp, "", f);
+	m_exitBlock = BasicBlock::Create(*m_interp, "", f);
+	m_until = false;
+
+	ir_builder builder(parent);
+	builder.CreateBr(bTest ? m_testBlock : m_bodyBlock);
+	m_interp->set_current_block(bTest ? m_testBlock : m_bodyBlock);
+	m_interp->push_context(this);
+}
+
+do_stmt::~do_stmt()
+{
+	//
+}
+
+// the branch out of a test: While goes on when c is true, Until when it is false
+static BranchInst* make_test_branch(ir_builder& builder, Value* cond, bool bUntil,
+		BasicBlock* body, BasicBlock* exit)
+{
+	if (bUntil)
+		return builder.CreateCondBr(cond, exit, body);
+	return builder.CreateCondBr(cond, body, exit);
+}
+
+void do_stmt::set_test(Value* cond, bool bUntil)
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_DO);
+	m_testEnd = m_interp->get_current_block();
+	ir_builder builder(m_testEnd);
+	m_testCond = m_interp->make_condition(cond, builder);
+	m_until = bUntil;
+	make_test_branch(builder, m_testCond, bUntil, m_bodyBlock, m_exitBlock);
+	m_interp->set_current_block(m_bodyBlock);
+}
+
+bool do_stmt::begin_loop_test()
+{
+	// Do While c ... Loop Until d
+	if (m_testBlock)
+		return false;
+	ir_builder builder(m_interp->get_current_block());
+	builder.CreateBr(m_latchBlock);
+	m_interp->set_current_block(m_latchBlock);
+	return true;
+}
+
+void do_stmt::make_loop(Value* cond, bool bUntil)
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_DO);
+	ir_builder builder(m_interp->get_current_block());
+	BranchInst* br = nullptr;
+	if (cond)
+	{
+		// Loop While/Until, the condition was built in the latch
+		br = make_test_branch(builder, m_interp->make_condition(cond, builder), bUntil, m_bodyBlock, m_exitBlock);
+	}
+	else
+	{
+		builder.CreateBr(m_latchBlock);
+		builder.SetInsertPoint(m_latchBlock);
+		if (m_testBlock && m_testBlock == m_testEnd)
+		{
+			// evaluate the test again, in the latch
+			ValueToValueMapTy vmap;
+			for (Instruction& I: *m_testBlock)
+			{
+				if (I.isTerminator())
+					break;
+				Instruction* pNew = I.clone();
+				RemapInstruction(pNew, vmap, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+				builder.Insert(pNew);
+				vmap[&I] = pNew;
+			}
+			Value* pCond = vmap.lookup(m_testCond);
+			br = make_test_branch(builder, pCond ? pCond : m_testCond, m_until, m_bodyBlock, m_exitBlock);
+		}
+		else if (m_testBlock)
+			br = builder.CreateBr(m_testBlock);
+		else
+			br = builder.CreateBr(m_bodyBlock);
+	}
+	br->setMetadata(LLVMContext::MD_loop, m_interp->make_loop_metadata(false));
+
+	m_interp->pop_context();
+	m_interp->set_current_block(m_exitBlock);
+}
+
+bool interpreter::make_loop_jump(int tok, bool bExit)
+{
+	BasicBlock* target = nullptr;
+	for (auto pObj: m_statementList)
+	{
+		// the loops outside of a Sub are not ours
+		if (pObj->type() == SUB || pObj->type() == FUNCTION)
+			break;
+		if (pObj->type() != tok)
+			continue;
+		if (tok == FOR)
+		{
+			for_stmt* pFor = static_cast<for_stmt*>(pObj);
+			target = bExit ? pFor->get_exit_block() : pFor->get_next_block();
+			if (bExit)
+				pFor->set_side_exit();
+		}
+		else
+		{
+			do_stmt* pDo = static_cast<do_stmt*>(pObj);
+			target = bExit ? pDo->get_exit_block() : pDo->get_latch_block();
+		}
+		break;
+	}
+	if (!target)
+		return false;
+
+	construct_scope cs(m_stats, tok == FOR ? compile_stats::CONSTRUCT_FOR : compile_stats::CONSTRUCT_DO);
+	ir_builder builder(m_activeBlock);
+	builder.CreateBr(target);
+	// whatever follows is unreachable, but it still needs a block
+	m_activeBlock = BasicBlock::Create(*this, "", m_activeBlock->getParent());
+	return true;
+}
@@ -0,0 +1,217 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <cmath>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Folding
+//
+// The IRBuilder already folds an operation on two constants. On top of
+// that, the expression builders drop the identities (x + 0, x * 1,
+// x / 1, ...) and lower ^ without calling pow() when they can:
+//   - constant ^ constant is computed here
+//   - integer ^ small constant is a chain of multiplies (integer ^
+//     integer is always an integer, basic_pow_long in the runtime)
+//   - floating-point ^ 2, 3 or 4 (or their negatives) is a chain too
+// --no-fold turns all of it off, to compare the IR. The results are
+// the same either way, make check runs the tests/pass programs both ways.
+/////////////////////////////////////////////////////////////////////////
+
+// the longest integer chain: x ^ 32 takes 5 squares
+static const int64_t MAX_POW_CHAIN = 32;
+// floating-point chains lose a little precision against pow(),
+// within a couple of ulps up to 4
+static const int64_t MAX_FP_POW_CHAIN = 4;
+
+static bool is_constant_value(Value* pVal, int64_t n)
+{
+	if (ConstantInt::classof(pVal))
+		return static_cast<ConstantInt*>(pVal)->getSExtValue() == n;
+	if (ConstantFP::classof(pVal))
+		return static_cast<ConstantFP*>(pVal)->isExactlyValue(static_cast<double>(n));
+	return false;
+}
+
+static bool is_negative_zero(Value* pVal)
+{
+	return ConstantFP::classof(pVal) && static_cast<ConstantFP*>(pVal)->isExactlyValue(-0.0);
+}
+
+// convertToDouble() only takes a double
+static double fp_value(ConstantFP* pConst)
+{
+	APFloat value = pConst->getValueAPF();
+	bool bLost = false;
+	value.convert(APFloat::IEEEdouble(), APFloat::rmNearestTiesToEven, &bLost);
+	return value.convertToDouble();
+}
+
+static bool constant_as_double(Value* pVal, double& d)
+{
+	if (ConstantInt::classof(pVal))
+	{
+		d = static_cast<double>(static_cast<ConstantInt*>(pVal)->getSExtValue());
+		return true;
+	}
+	if (ConstantFP::classof(pVal))
+	{
+		d = fp_value(static_cast<ConstantFP*>(pVal));
+		return true;
+	}
+	return false;
+}
+
+// the exponent as an integer, if it is a constant with an integral value
+static bool get_integral_exponent(Value* pVal, int64_t& n)
+{
+	if (ConstantInt::classof(pVal))
+	{
+		n = static_cast<ConstantInt*>(pVal)->getSExtValue();
+		return true;
+	}
+	if (ConstantFP::classof(pVal))
+	{
+		double d = fp_value(static_cast<ConstantFP*>(pVal));
+		if (d != std::trunc(d) || std::fabs(d) > MAX_POW_CHAIN)
+			return false;
+		n = static_cast<int64_t>(d);
+		return true;
+	}
+	return false;
+}
+
+// x ^ n, n >= 1, by squaring,
+// the integer multiplies are checked like any other
+static Value* make_power_chain(interpreter* pInterp, Value* pBase, uint64_t n)
+{
+	bool bFloat = pBase->getType()->isFloatingPointTy();
+	auto multiply = [&](Value* a, Value* b) -> Value* {
+		if (!bFloat)
+			return pInterp->make_int_arith(Instruction::Mul, a, b);
+		ir_builder builder(pInterp->get_current_block());
+		return builder.CreateFMul(a, b);
+	};
+
+	Value* pResult = nullptr;
+	Value* pSquare = pBase;
+	while (n)
+	{
+		if (n & 1)
+			pResult = pResult ? multiply(pResult, pSquare) : pSquare;
+		n >>= 1;
+		if (n)
+			pSquare = multiply(pSquare, pSquare);
+	}
+	return pResult;
+}
+
+Value* interpreter::fold_binary(Instruction::BinaryOps op, Value* p1, Value* p2)
+{
+	if (!m_fold)
+		return nullptr;
+
+	switch (op)
+	{
+	case Instruction::Add:
+		if (is_constant_value(p2, 0))
+			return p1;
+		if (is_constant_value(p1, 0))
+			return p2;
+		break;
+	case Instruction::FAdd:
+		// x + 0.0 is not x when x is -0.0
+		if (is_negative_zero(p2))
+			return p1;
+		if (is_negative_zero(p1))
+			return p2;
+		break;
+	case Instruction::Sub:
+	case Instruction::FSub:
+		if (is_constant_value(p2, 0))
+			return p1;
+		break;
+	case Instruction::Mul:
+		if (is_constant_value(p2, 1) || is_constant_value(p1, 0))
+			return p1;
+		if (is_constant_value(p1, 1) || is_constant_value(p2, 0))
+			return p2;
+		break;
+	case Instruction::FMul:
+		// but not x * 0.0, NaN and Inf don't give 0
+		if (is_constant_value(p2, 1))
+			return p1;
+		if (is_constant_value(p1, 1))
+			return p2;
+		break;
+	case Instruction::SDiv:
+	case Instruction::FDiv:
+		if (is_constant_value(p2, 1))
+			return p1;
+		if (op == Instruction::FDiv && ConstantFP::classof(p2))
+		{
+			// dividing by a power of two is multiplying by its inverse, exactly
+			APFloat inverse(0.0);
+			if (static_cast<ConstantFP*>(p2)->getValueAPF().getExactInverse(&inverse))
+			{
+				ir_builder builder(m_activeBlock);
+				return builder.CreateFMul(p1, ConstantFP::get(*this, inverse));
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	return nullptr;
+}
+
+Value* interpreter::fold_pow(Value* lhs, Value* rhs)
+{
+	if (!m_fold)
+		return nullptr;
+
+	ir_builder builder(m_activeBlock);
+	Type* baseType = is_variable(lhs) ? get_variable_type(lhs) : lhs->getType();
+	Type* expType = is_variable(rhs) ? get_variable_type(rhs) : rhs->getType();
+	if (baseType->isIntegerTy(1) || expType->isIntegerTy(1))
+		return nullptr;
+
+	// both constants, one of them floating-point: computed here,
+	// with the same libm as the program
+	double x = 0.0, y = 0.0;
+	if ((ConstantFP::classof(lhs) || ConstantFP::classof(rhs))
+			&& constant_as_double(lhs, x) && constant_as_double(rhs, y))
+		return ConstantFP::get(builder.getDoubleTy(), std::pow(x, y));
+
+	int64_t n = 0;
+	bool bConstExp = get_integral_exponent(rhs, n);
+
+	if (baseType->isIntegerTy() && expType->isIntegerTy())
+	{
+		// integer ^ constant, in the wider of the two types,
+		// make_pow() calls the runtime for the others
+		if (!bConstExp || n < 0 || (n > MAX_POW_CHAIN && !Constant::classof(lhs)))
+			return nullptr;
+		Type* t = baseType->getIntegerBitWidth() >= expType->getIntegerBitWidth() ? baseType : expType;
+		if (n == 0)
+			return ConstantInt::get(t, 1);
+		Value* pBase = is_variable(lhs) ? builder.CreateLoad(lhs) : lhs;
+		pBase = builder.CreateIntCast(pBase, t, is_signed_type(baseType));
+		// a constant base folds as it goes
+		return make_power_chain(this, pBase, static_cast<uint64_t>(n));
+	}
+
+	if (baseType->isFloatingPointTy() && bConstExp && n >= -MAX_FP_POW_CHAIN && n <= MAX_FP_POW_CHAIN)
+	{
+		// x ^ 0 is 1 even for NaN
+		if (n == 0)
+			return ConstantFP::get(baseType, 1.0);
+		Value* pBase = is_variable(lhs) ? builder.CreateLoad(lhs) : lhs;
+		Value* pResult = make_power_chain(this, pBase, static_cast<uint64_t>(n < 0 ? -n : n));
+		if (n < 0)
+			pResult = builder.CreateFDiv(ConstantFP::get(baseType, 1.0), pResult);
+		return pResult;
+	}
+	return nullptr;
+}
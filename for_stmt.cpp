@@ -1,23 +1,25 @@
 #include "basic.h"
 #include "parser.hpp"
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/IntrinsicInst.h>
 
 using namespace llvm;
 using namespace basic;
 
-extern basic::interpreter* interp;
-
-for_stmt::for_stmt()
-	: statement(FOR, "For")
+for_stmt::for_stmt(interpreter* pInterp)
+	: statement(pInterp, FOR, "For")
 {
-	m_parentBlock = interp->get_current_block();
+	m_parentBlock = m_interp->get_current_block();
 }
 
-for_stmt::for_stmt(BasicBlock* parentBlock, Value* vCounter)
-	: statement(FOR, "For")
+for_stmt::for_stmt(interpreter* pInterp, BasicBlock* parentBlock, Value* vCounter)
+	: statement(pInterp, FOR, "For")
 {
 	m_parentBlock = parentBlock;
 	m_varCounter = vCounter;
-	if (!AllocaInst::classof(vCounter))
+	m_noWrap = false;
+	m_sideExit = false;
+	if (!m_interp->is_variable(vCounter))
 	{
 		std::string buff("WARNING: FOR loop using something other than a variable could lead into undefined result.\n");
 		raw_string_ostream rso(buff);
@@ -29,7 +31,7 @@ for_stmt::for_stmt(BasicBlock* parentBlock, Value* vCounter)
 
 // For created with another For buddy, must be a Next
 for_stmt::for_stmt(for_stmt* prev)
-	: statement(NEXT, "Next")
+	: statement(prev->m_interp, NEXT, "Next")
 {
 	//
 }
@@ -42,75 +44,202 @@ for_stmt::~for_stmt()
 ////////////////////////////////////////
 // What if we got something like:
 //
-// For i = j To k
+// For i = j To k Step n
 //    DoStuffs
 // Next i
 //
 ////////////////////////////////////////
-// The parser have to make sure that
-// we will get a CONSTANTs for both
-// start and end value
+// The bounds and the step can be any
+// expression, they are evaluated once
+// before the loop, in the counter type.
+// A negative step counts down.
+//
+// The loop is emitted rotated: the start
+// block only decides if the body runs at
+// all, the Next block increments and
+// tests again, and is the only latch.
 //
 bool for_stmt::set_condition(Value* vStart, Value* vEnd)
 {
 	// simply use int32(1) as default increment value
 	return set_condition(vStart, vEnd,
-			ConstantInt::get(Type::getInt32Ty(*interp), 1));
+			ConstantInt::get(Type::getInt32Ty(*m_interp), 1));
+}
+
+// load the variable if it is one, and cast it to the counter type
+static Value* evaluate_once(interpreter* pInterp, Value* pVal, Type* t, ir_builder& builder)
+{
+	if (pInterp->is_variable(pVal))
+		pVal = builder.CreateLoad(pVal);
+	return pInterp->cast_for_assignment(pVal, t);
+}
+
+// With constant bounds, the counter can't overflow when its last value
+// (the first one past the end) still fits in the counter type,
+// so the increment is nsw and LLVM gets a constant trip count.
+// That only holds if the body leaves the counter alone, see write_next().
+static bool is_counted_loop(Value* vStart, Value* vEnd, Value* vStep)
+{
+	if (!ConstantInt::classof(vStart) || !ConstantInt::classof(vEnd) || !ConstantInt::classof(vStep))
+		return false;
+	const APInt& start = static_cast<ConstantInt*>(vStart)->getValue();
+	const APInt& end = static_cast<ConstantInt*>(vEnd)->getValue();
+	const APInt& step = static_cast<ConstantInt*>(vStep)->getValue();
+	if (step.isNullValue())
+		return false;
+
+	// the body never runs, so the increment never happens
+	if (step.isNegative() ? end.sgt(start) : end.slt(start))
+		return true;
+
+	unsigned nBits = start.getBitWidth();
+	APInt trips = (end.sext(128) - start.sext(128)).sdiv(step.sext(128)) + 1;
+	APInt last = start.sext(128) + trips * step.sext(128);
+	return last.isSignedIntN(nBits);
+}
+
+// The body is what can be reached from its first block
+// without going through Next or the exit
+static void get_body_blocks(BasicBlock* loop, BasicBlock* next, BasicBlock* exit,
+		SmallVectorImpl<BasicBlock*>& body)
+{
+	SmallPtrSet<BasicBlock*, 16> visited;
+	SmallVector<BasicBlock*, 16> work;
+	work.push_back(loop);
+	visited.insert(loop);
+	visited.insert(next);
+	visited.insert(exit);
+	while (!work.empty())
+	{
+		BasicBlock* bb = work.pop_back_val();
+		body.push_back(bb);
+		// the unreachable block after an Exit For is not terminated
+		if (!bb->getTerminator())
+			continue;
+		for (BasicBlock* succ: successors(bb))
+		{
+			if (visited.insert(succ).second)
+				work.push_back(succ);
+		}
+	}
+}
+
+// The body may assign the counter (For i = 1 To 10 : i = 2147483647),
+// then the increment can overflow after all. A global counter
+// (incremental mode) may also be changed by any call.
+static bool body_changes_counter(ArrayRef<BasicBlock*> body, Value* counter)
+{
+	bool bGlobal = !AllocaInst::classof(counter);
+	for (BasicBlock* bb: body)
+	{
+		for (Instruction& I: *bb)
+		{
+			if (StoreInst::classof(&I) && static_cast<StoreInst&>(I).getPointerOperand() == counter)
+				return true;
+			if (bGlobal && CallInst::classof(&I))
+				return true;
+		}
+	}
+	return false;
+}
+
+// Only a loop over array elements that calls nothing (Print, the String
+// runtime, a Sub) is worth forcing the vectorizer on, the others get a
+// "loop not vectorized" warning. A forced loop may also have its
+// floating-point sums reordered, so a Single or Double stored to a plain
+// variable (s = s + a(i)) needs --fast-math.
+static bool is_array_loop(ArrayRef<BasicBlock*> body, interpreter* pInterp)
+{
+	bool bElements = false;
+	for (BasicBlock* bb: body)
+	{
+		for (Instruction& I: *bb)
+		{
+			// the cold error calls of the index checks don't count
+			if (CallInst::classof(&I) && !IntrinsicInst::classof(&I)
+					&& !static_cast<CallInst&>(I).doesNotReturn())
+				return false;
+			Value* ptr = nullptr;
+			if (LoadInst::classof(&I))
+				ptr = static_cast<LoadInst&>(I).getPointerOperand();
+			else if (StoreInst::classof(&I))
+			{
+				StoreInst& store = static_cast<StoreInst&>(I);
+				ptr = store.getPointerOperand();
+				if (!pInterp->is_element(ptr) && !pInterp->get_fast_math()
+					&& store.getValueOperand()->getType()->isFloatingPointTy())
+					return false;
+			}
+			if (ptr && pInterp->is_element(ptr))
+				bElements = true;
+		}
+	}
+	return bElements;
+}
+
+// the exit test, counting up or down
+static Value* make_past_end(ir_builder& builder, Value* pCounter, Value* pEnd, bool bDown)
+{
+	if (pCounter->getType()->isFloatingPointTy())
+		return bDown ? builder.CreateFCmpOLT(pCounter, pEnd) : builder.CreateFCmpOGT(pCounter, pEnd);
+	return bDown ? builder.CreateICmpSLT(pCounter, pEnd) : builder.CreateICmpSGT(pCounter, pEnd);
+}
+
+// true when the counter went past the end value, in the direction of the step
+Value* for_stmt::make_exit_test(ir_builder& builder, Value* pCounter)
+{
+	if (ConstantInt::classof(m_down))
+		return make_past_end(builder, pCounter, m_endValue, static_cast<ConstantInt*>(m_down)->isOne());
+	return builder.CreateSelect(m_down,
+			make_past_end(builder, pCounter, m_endValue, true),
+			make_past_end(builder, pCounter, m_endValue, false));
 }
 
 bool for_stmt::set_condition(Value* vStart, Value* vEnd, Value* vStep)
 {
-	m_startValue = vStart;
-	m_endValue = vEnd;
-	m_stepValue = vStep;
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_FOR);
 
 	Function* f = m_parentBlock->getParent();
-	m_startBlock = BasicBlock::Create(*interp, "", f);
-	m_loopBlock  = BasicBlock::Create(*interp, "", f);
-	m_nextBlock  = BasicBlock::Create(*interp, "", f);
-	m_exitBlock  = BasicBlock::Create(*interp, "", f);
+	m_startBlock = BasicBlock::Create(*m_interp, "", f);
+	m_loopBlock  = BasicBlock::Create(*m_interp, "", f);
+	m_nextBlock  = BasicBlock::Create(*m_interp, "", f);
+	m_exitBlock  = BasicBlock::Create(*m_interp, "", f);
 
 	// before we jump, set the variable to the value of vStart
-	IRBuilder<> builder(m_parentBlock);
+	ir_builder builder(m_parentBlock);
+
+	// adjust the Type as required, the end and the step
+	// stay in registers for the whole loop
+	Type* t = m_interp->get_variable_type(m_varCounter);
+	m_startValue = evaluate_once(m_interp, vStart, t, builder);
+	m_endValue = evaluate_once(m_interp, vEnd, t, builder);
+	m_stepValue = evaluate_once(m_interp, vStep, t, builder);
+	m_noWrap = t->isIntegerTy() && is_counted_loop(m_startValue, m_endValue, m_stepValue);
 
-	// adjust the Type as required
-	AllocaInst* inst = static_cast<AllocaInst*>(m_varCounter);
-	Type* t = inst->getAllocatedType();
-	Value* pVal = interp->cast_for_assignment(vStart, t);
 	// assign the value
-	builder.CreateStore(pVal, m_varCounter);
-	
-	if (t->isIntegerTy())
-		m_stepValue = ConstantInt::get(t, 1);
+	builder.CreateStore(m_startValue, m_varCounter);
+
+	// which way we count, a constant unless the step is not
+	if (t->isFloatingPointTy())
+		m_down = builder.CreateFCmpOLT(m_stepValue, ConstantFP::get(t, 0.0));
 	else
-		m_stepValue = ConstantFP::get(t, 1.0);
+		m_down = builder.CreateICmpSLT(m_stepValue, ConstantInt::get(t, 0));
 
 	// ready to jump
 	builder.CreateBr(m_startBlock);
 
-	// the startBlock jobdesc is only checking if the counter
-	// reached the maximum value refering to vEnd
+	// the startBlock jobdesc is only checking if the body
+	// runs at least once, the Next block does the rest
 	builder.SetInsertPoint(m_startBlock);
 
-	// needed by cast_as_needed to work
-	interp->set_current_block(m_startBlock);
-
-	auto [p1, p2] = interp->cast_as_needed(m_varCounter, vEnd);
-	t = p1->getType();
-
-	Value* cond = nullptr;
-	if (t->isFloatingPointTy())
-		cond = builder.CreateFCmpOGT(p1, p2);
-	else
-		cond = builder.CreateICmpSGT(p1, p2);
-
-	builder.CreateCondBr(cond, m_exitBlock, m_loopBlock);
+	Value* pCounter = builder.CreateLoad(m_varCounter);
+	builder.CreateCondBr(make_exit_test(builder, pCounter), m_exitBlock, m_loopBlock);
 
 	// we will write the definition for Next, when the user
 	// writing next in the command-line
 	// then the parser will be called
-	interp->push_context(this);
-	interp->set_current_block(m_loopBlock);
+	m_interp->push_context(this);
+	m_interp->set_current_block(m_loopBlock);
 	return true;
 }
 
@@ -123,38 +252,51 @@ void for_stmt::get_debug_string(std::string& buffer)
 
 bool for_stmt::is_equal(const char* strId)
 {
-	if (m_varCounter->getName() == strId)
+	// BASIC names are case-insensitive
+	if (m_varCounter->getName().equals_lower(strId))
 		return true;
 	return false;
 }
 
 void for_stmt::write_next()
 {
-	IRBuilder<> builder(interp->get_current_block());
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_FOR);
+	ir_builder builder(m_interp->get_current_block());
 	builder.CreateBr(m_nextBlock);
-	interp->set_current_block(m_nextBlock);
+	m_interp->set_current_block(m_nextBlock);
 
 	builder.SetInsertPoint(m_nextBlock);
 
 	// we simply increment the varCounter using value of m_stepValue
-	auto [p1, p2] = interp->cast_as_needed(m_varCounter, m_stepValue);
+	auto [p1, p2] = m_interp->cast_as_needed(m_varCounter, m_stepValue);
 
 	// p1 = m_varCounter::value
 	// p2 = m_stepValue (casted to matched the type, if needed)
-	Value* pRes = builder.CreateAdd(p1, p2);
+	SmallVector<BasicBlock*, 16> body;
+	get_body_blocks(m_loopBlock, m_nextBlock, m_exitBlock, body);
+	if (m_noWrap && body_changes_counter(body, m_varCounter))
+		m_noWrap = false;
+	Value* pRes = nullptr;
+	if (p1->getType()->isFloatingPointTy())
+		pRes = builder.CreateFAdd(p1, p2);
+	else
+		pRes = builder.CreateAdd(p1, p2, "", false, m_noWrap);
 	// store the value
 	builder.CreateStore(pRes, m_varCounter);
 
-	// Now, after finishing our work, we should make a branch to m_startBlock
-	builder.CreateBr(m_startBlock);
+	// Now, after finishing our work, we test again and go back to the body,
+	// the back edge carries the loop metadata for the vectorizer
+	BranchInst* br = builder.CreateCondBr(make_exit_test(builder, pRes), m_exitBlock, m_loopBlock);
+	bool bForce = !m_sideExit && is_array_loop(body, m_interp);
+	br->setMetadata(LLVMContext::MD_loop, m_interp->make_loop_metadata(bForce));
 
 	// but because user write this at the end of the block,
 	// then we must set the current interpreter insert point to
 	// our exit point.
 	// And then we will also have to pop the current for_stmt out from the list
 	
-	interp->pop_context();
-	interp->set_current_block(m_exitBlock);
+	m_interp->pop_context();
+	m_interp->set_current_block(m_exitBlock);
 
 	// everything should be okay...
 }
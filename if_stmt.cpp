@@ -1,37 +1,43 @@
 #include "basic.h"
 #include "parser.hpp"
+#include <llvm/Analysis/ValueTracking.h>
 
 using namespace basic;
 using namespace llvm;
 
-extern basic::interpreter* interp;
-
-if_stmt::if_stmt() : statement(IF, "If")
+if_stmt::if_stmt(interpreter* pInterp) : statement(pInterp, IF, "If")
 {
-	m_parentBlock = interp->get_current_block();
+	m_parentBlock = m_interp->get_current_block();
 	m_cond = nullptr;
+	m_branch = nullptr;
 	m_trueBlock = m_exitBlock = m_falseBlock = nullptr;
+	m_singleLine = false;
 }
 
-if_stmt::if_stmt(BasicBlock* parent) : statement(IF, "If")
+if_stmt::if_stmt(interpreter* pInterp, BasicBlock* parent) : statement(pInterp, IF, "If")
 {
 	m_parentBlock = parent;
 	m_cond = nullptr;
+	m_branch = nullptr;
 	m_trueBlock = m_exitBlock = m_falseBlock = nullptr;
+	m_singleLine = false;
 }
 
-if_stmt::if_stmt(BasicBlock* parent, Value* cond) : statement(IF, "If")
+if_stmt::if_stmt(interpreter* pInterp, BasicBlock* parent, Value* cond) : statement(pInterp, IF, "If")
 {
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_IF);
 	m_parentBlock = parent;
-	m_cond = cond;
 	Function* f = parent->getParent();
-	m_trueBlock = BasicBlock::Create(*interp, "", f);
-	m_falseBlock = BasicBlock::Create(*interp, "", f);
-	m_exitBlock = m_exitBlock;
-	IRBuilder<> builder(parent);
-	m_branch = builder.CreateCondBr(cond, m_trueBlock, m_falseBlock);
-	interp->set_current_block(m_trueBlock);
-	interp->push_context(this);
+	m_trueBlock = BasicBlock::Create(*m_interp, "", f);
+	m_falseBlock = BasicBlock::Create(*m_interp, "", f);
+	// every arm jumps here when it is done
+	m_exitBlock = BasicBlock::Create(*m_interp, "", f);
+	ir_builder builder(parent);
+	m_cond = m_interp->make_condition(cond, builder);
+	m_branch = builder.CreateCondBr(m_cond, m_trueBlock, m_falseBlock);
+	m_singleLine = false;
+	m_interp->set_current_block(m_trueBlock);
+	m_interp->push_context(this);
 }
 
 if_stmt::~if_stmt()
@@ -39,24 +45,44 @@ if_stmt::~if_stmt()
 	//
 }
 
-// This can be use to create ElseIf, Else, or EndIf
+// This can be use to create ElseIf, or Else.
+// begin_next_arm() must have been called on topIf already.
 if_stmt::if_stmt(if_stmt* topIf, int tok, const char* iname)
-	: statement(tok, iname)
+	: statement(topIf->m_interp, tok, iname)
 {
 	topIf->m_next = this;
 	m_prev = topIf;
-	m_parentBlock = topIf->m_trueBlock;
-	m_cond = nullptr;
-	m_trueBlock = topIf->m_falseBlock;
-	m_falseBlock = BasicBlock::Create(*interp, "", m_parentBlock->getParent());
-	topIf->m_exitBlock = m_falseBlock;
-	m_exitBlock = m_falseBlock;
+	m_singleLine = topIf->m_singleLine;
+	// the condition of an ElseIf was evaluated in the false block
+	// of the previous arm, an Else simply takes it over as its body
+	m_parentBlock = topIf->m_falseBlock;
+	m_exitBlock = topIf->m_exitBlock;
+	if (tok == ELSE)
+	{
+		m_trueBlock = m_parentBlock;
+		m_falseBlock = nullptr;
+	}
+	else
+	{
+		Function* f = m_parentBlock->getParent();
+		m_trueBlock = BasicBlock::Create(*m_interp, "", f);
+		m_falseBlock = BasicBlock::Create(*m_interp, "", f);
+	}
 
 	// we do not have a condition, so we cannot make the branch
 	m_branch = nullptr;
 	m_cond = nullptr;
 }
 
+void if_stmt::begin_next_arm()
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_IF);
+	// the arm we are leaving is done
+	ir_builder builder(m_interp->get_current_block());
+	builder.CreateBr(m_exitBlock);
+	m_interp->set_current_block(m_falseBlock);
+}
+
 BasicBlock* if_stmt::true_block()
 {
 	return m_trueBlock;
@@ -91,6 +117,7 @@ void if_stmt::get_debug_string(std::string& buffer)
 
 Value* if_stmt::set_branch(Value* cond)
 {
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_IF);
 	if (m_branch)
 	{
 		std::string buff("Warning: if_stmt::set_branch\nThe condition already set: ");
@@ -101,37 +128,141 @@ Value* if_stmt::set_branch(Value* cond)
 		std::cerr << buff << "\nIgnoring the new conditional statement\n";
 		return m_branch;
 	}
-	m_cond = cond;
-	
-	// The insert point should be set to the parentBlock
-	// So if we've been created using another if_stmt as the first argument,
-	// the m_parentBlock should be set to topIf->true_block(),
-	// otherwise the resulting branch will be in a wrong place.
-	IRBuilder<> builder(m_parentBlock);
-	m_branch = builder.CreateCondBr(cond, m_trueBlock, m_falseBlock);
-	interp->push_context(this);
-	interp->set_current_block(m_trueBlock);
+
+	// used by ELSEIF, the condition was evaluated in the current block,
+	// which started out as the false block of the previous arm
+	ir_builder builder(m_interp->get_current_block());
+	m_cond = m_interp->make_condition(cond, builder);
+	m_branch = builder.CreateCondBr(m_cond, m_trueBlock, m_falseBlock);
+	m_interp->push_context(this);
+	m_interp->set_current_block(m_trueBlock);
 	return m_branch;
 }
 
 Value* if_stmt::set_branch()
 {
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_IF);
 	// used by ELSE
-	// we have no conditions, so jump directly
-	std::cerr << m_name << "::set_branch()\n";
-	IRBuilder<> builder(m_parentBlock);
-	m_branch = builder.CreateBr(m_trueBlock);
-	interp->push_context(this);
-	interp->set_current_block(m_trueBlock);
-	return m_branch;
+	// the previous arm already jumped to the exit,
+	// we simply carry on in its false block
+	BASIC_TRACE(TRACE_CODEGEN, 2, trace::write(m_name + "::set_branch()"));
+	m_interp->push_context(this);
+	m_interp->set_current_block(m_trueBlock);
+	return nullptr;
+}
+
+// If c Then x = a [Else x = b] End If, without a branch:
+// the arms may only hold a few instructions without side effects,
+// then at most one store to a variable.
+
+static bool is_select_arm(BasicBlock* arm, BasicBlock* parent, BasicBlock* exit, StoreInst*& store)
+{
+	store = nullptr;
+	// no arm at all, the branch goes straight to the exit
+	if (arm == exit)
+		return true;
+	if (arm->getSinglePredecessor() != parent)
+		return false;
+	// a nested If or For leaves the arm in another block
+	Instruction* term = arm->getTerminator();
+	if (!BranchInst::classof(term) || static_cast<BranchInst*>(term)->isConditional()
+			|| term->getSuccessor(0) != exit)
+		return false;
+
+	// the store must be the last one, the others can't be speculated
+	BasicBlock::iterator end = term->getIterator();
+	if (end != arm->begin() && StoreInst::classof(&*std::prev(end)))
+	{
+		// a variable, an array index may be out of bounds
+		store = static_cast<StoreInst*>(&*std::prev(end));
+		Value* ptr = store->getPointerOperand();
+		if (!AllocaInst::classof(ptr) && !GlobalVariable::classof(ptr))
+			return false;
+		end = store->getIterator();
+	}
+	return is_speculatable(arm->begin(), end);
+}
+
+// both arms are evaluated in front of the branch, and the
+// variable gets select(c, a, b). Returns the new branch to
+// the exit, or null if the arms do not qualify.
+static BranchInst* make_select(BranchInst* condBr, BasicBlock* exit)
+{
+	BasicBlock* parent = condBr->getParent();
+	BasicBlock* arms[] = { condBr->getSuccessor(0), condBr->getSuccessor(1) };
+	StoreInst* stores[] = { nullptr, nullptr };
+	for (int i = 0; i < 2; i++)
+	{
+		if (!is_select_arm(arms[i], parent, exit, stores[i]))
+			return nullptr;
+	}
+	if (arms[0] == arms[1])
+		return nullptr;
+	if (stores[0] && stores[1] && stores[0]->getPointerOperand() != stores[1]->getPointerOperand())
+		return nullptr;
+
+	for (int i = 0; i < 2; i++)
+	{
+		if (arms[i] == exit)
+			continue;
+		Instruction* last = stores[i] ? static_cast<Instruction*>(stores[i]) : arms[i]->getTerminator();
+		parent->getInstList().splice(condBr->getIterator(), arms[i]->getInstList(),
+				arms[i]->begin(), last->getIterator());
+	}
+
+	ir_builder builder(condBr);
+	if (stores[0] || stores[1])
+	{
+		// the arm without a store keeps the current value
+		Value* ptr = (stores[0] ? stores[0] : stores[1])->getPointerOperand();
+		Value* v1 = stores[0] ? stores[0]->getValueOperand() : builder.CreateLoad(ptr);
+		Value* v2 = stores[1] ? stores[1]->getValueOperand() : builder.CreateLoad(ptr);
+		builder.CreateStore(builder.CreateSelect(condBr->getCondition(), v1, v2), ptr);
+	}
+	BranchInst* br = builder.CreateBr(exit);
+	condBr->eraseFromParent();
+	for (int i = 0; i < 2; i++)
+	{
+		if (arms[i] != exit)
+			arms[i]->eraseFromParent();
+	}
+	return br;
 }
 
 Value* if_stmt::make_end_if()
 {
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_IF);
 	// Used by END IF
-	IRBuilder<> builder(m_trueBlock);
-	m_branch = builder.CreateBr(m_falseBlock);
-	interp->set_current_block(m_exitBlock);
+	// the last arm is done, and without an Else, the last condition
+	// being false goes straight to the exit, without a block of its own
+	BranchInst* condBr = static_cast<BranchInst*>(m_branch);
+	ir_builder builder(m_interp->get_current_block());
+	m_branch = builder.CreateBr(m_exitBlock);
+	if (m_falseBlock)
+	{
+		condBr->setSuccessor(1, m_exitBlock);
+		m_falseBlock->eraseFromParent();
+		m_falseBlock = nullptr;
+	}
+	m_interp->set_current_block(m_exitBlock);
+
+	// a lone If, or an If with an Else, may become a select
+	if_stmt* top = this;
+	if (m_type == ELSE)
+	{
+		top = static_cast<if_stmt*>(m_prev);
+		condBr = top->m_prev ? nullptr : static_cast<BranchInst*>(top->m_branch);
+	}
+	else if (m_type != IF)
+		condBr = nullptr;
+	if (condBr)
+	{
+		BranchInst* br = make_select(condBr, m_exitBlock);
+		if (br)
+		{
+			m_branch = br;
+			top->m_branch = br;
+		}
+	}
 	return m_branch;
 }
-
@@ -1,36 +1,85 @@
 #include "basic.h"
 #include "parser.hpp"
 #include <llvm/IR/ValueSymbolTable.h>
+#include <llvm/IR/MDBuilder.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
 
 using namespace basic;
 using namespace llvm;
 
-static int BASIC_INTERPRETER_VERSION = 0x09;
+static int BASIC_INTERPRETER_VERSION = 0x0a;
 
+// the reentrant scanner, see lexer.l
+typedef void* yyscan_t;
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
-extern YY_BUFFER_STATE yy_scan_string(const char* strBuff);
-extern void yy_delete_buffer(YY_BUFFER_STATE pbuff);
+extern int yylex_init_extra(interpreter* pInterp, yyscan_t* scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern YY_BUFFER_STATE yy_scan_string(const char* strBuff, yyscan_t scanner);
+extern YY_BUFFER_STATE yy_scan_buffer(char* base, size_t size, yyscan_t scanner);
+extern void yy_delete_buffer(YY_BUFFER_STATE pbuff, yyscan_t scanner);
 
 void yyerror(basic::interpreter* p, const char* msg)
 {
 	std::cerr << "error: " << msg << "\n";
 }
 
-extern interpreter* interp;
 interpreter::interpreter(const char* modname)
+	: m_context(std::make_unique<LLVMContext>())
+{
+	// the default handler still reports the diagnostics, the
+	// context only keeps a way back to us for from_context()
+	m_context.getContext()->setDiagnosticHandlerCallBack(nullptr, this);
+	// the scanner hands us back to the actions as yyextra
+	m_scanner = nullptr;
+	yylex_init_extra(this, &m_scanner);
+	m_modName = modname;
+	m_incremental = false;
+	m_chunkCount = 0;
+	m_optLevel = 0;
+	m_errorCount = 0;
+	m_cpu = "generic";
+	m_lexerTiming = false;
+	m_vectorize = true;
+	m_fastMath = false;
+	m_fold = true;
+	m_checkedArith = false;
+	m_library = false;
+	Type* i64 = Type::getInt64Ty(*this);
+	Type* fields[] = { i64, i64, Type::getInt8PtrTy(*this), i64 };
+	m_stringType = StructType::create(*this, fields, "basic.string");
+	MDBuilder mdb(*this);
+	m_aliasDomain = mdb.createAnonymousAliasScopeDomain("basic");
+	m_variableScope = mdb.createAnonymousAliasScope(m_aliasDomain, "variables");
+	m_variableScopes = MDNode::get(*this, ArrayRef<Metadata*>(m_variableScope));
+	m_compileTime = m_executeTime = 0.0;
+	create_module(modname, "main");
+}
+
+void interpreter::create_module(const std::string& modname, const char* fnName)
 {
-	interp = this;
 	module = std::make_unique<Module>(modname, *this);
 
 	// an interpreter MUST have at least a 'main' function
 	// as its default, along with the default entry, and,
 	// if necessary, an exit block
+	// main() returns int, the statements in incremental mode return void
+	Type* retType = Type::getVoidTy(*this);
+	if (!strcmp(fnName, "main"))
+		retType = Type::getInt32Ty(*this);
 	Function* fmain = Function::Create(
-			FunctionType::get(Type::getVoidTy(*this), false),
-			Function::ExternalLinkage, "main", module.get());
+			FunctionType::get(retType, false),
+			Function::ExternalLinkage, fnName, module.get());
 	m_entryBlock = BasicBlock::Create(*this, "entry", fmain);
 	m_exitBlock = BasicBlock::Create(*this, "exit", fmain);
 
+	m_printUsed = false;
+
 	// the activeBlock can change overtime,
 	// depending on who's currently using it
 	m_activeBlock = m_entryBlock;
@@ -41,21 +90,133 @@ interpreter::interpreter(const char* modname)
 			FunctionType::get(Type::getInt32Ty(*this), ArrayRef<Type*>(Type::getInt8PtrTy(*this)), false));
 }
 
+void interpreter::set_incremental(bool bIncremental)
+{
+	m_incremental = bIncremental;
+	if (m_incremental)
+		next_chunk();
+}
+
+void interpreter::next_chunk()
+{
+	// every top-level statement gets its own module and function,
+	// the variables are kept alive in the JIT as globals.
+	std::string fnName("__basic_stmt_");
+	fnName += std::to_string(m_chunkCount++);
+	create_module(m_modName + "." + fnName, fnName.c_str());
+	m_symbols.forget_globals();
+	// they all belong to the previous module
+	m_arrays.clear();
+	m_elements.clear();
+	m_literals.clear();
+	m_stringTemps.clear();
+	m_errorBlocks.clear();
+}
+
 interpreter::~interpreter()
 {
+	// the JIT must go before the context it was compiled from
+	m_jit.reset();
+	// and the lazy modules before the bitcode they read
+	m_libraries.clear();
 	//module.release();
-	std::cerr << "interpreter deleted\n";
-	interp = nullptr;
+	yylex_destroy(m_scanner);
+	BASIC_TRACE(TRACE_CODEGEN, 2, trace::write("interpreter deleted"));
 }
 
-int interpreter::eval(const std::string& strLine)
+int interpreter::parse()
 {
-	YY_BUFFER_STATE state = yy_scan_string(strLine.c_str());
+	// the lexer time is included, but it is reported on its own
+	double lexTime = m_stats.get_time(compile_stats::PHASE_LEX);
+	auto t0 = std::chrono::steady_clock::now();
 	int result = yyparse(this);
-	yy_delete_buffer(state);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+	lexTime = m_stats.get_time(compile_stats::PHASE_LEX) - lexTime;
+	m_stats.add_time(compile_stats::PHASE_PARSE, elapsed.count() - lexTime);
+	return result;
+}
+
+int interpreter::eval(const std::string& strLine)
+{
+	// the end of the line ends a single-line If
+	std::string strSource = strLine + "\n";
+	int nErrors = m_errorCount;
+	YY_BUFFER_STATE state = yy_scan_string(strSource.c_str(), m_scanner);
+	int result = parse();
+	yy_delete_buffer(state, m_scanner);
+
+	// the line was recovered from, but it is not a statement
+	if (result == 0 && m_errorCount > nErrors)
+		result = 1;
+	return result;
+}
+
+int interpreter::eval_file(const char* pszPath)
+{
+	int fd = open(pszPath, O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << "basic: cannot open " << pszPath << ": " << strerror(errno) << "\n";
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		std::cerr << "basic: cannot stat " << pszPath << ": " << strerror(errno) << "\n";
+		close(fd);
+		return -1;
+	}
+
+	// flex wants the buffer to end with two NULs, and it writes into
+	// the buffer while scanning. So we reserve a zeroed, private mapping
+	// with room for the terminator, then map the file on top of it.
+	size_t size = st.st_size;
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t mapSize = (size + 2 + pageSize - 1) & ~(pageSize - 1);
+	char* base = static_cast<char*>(mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (base == MAP_FAILED)
+	{
+		std::cerr << "basic: mmap failed: " << strerror(errno) << "\n";
+		close(fd);
+		return -1;
+	}
+	if (size > 0 && mmap(base, size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		std::cerr << "basic: cannot map " << pszPath << ": " << strerror(errno) << "\n";
+		munmap(base, mapSize);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	// the whole program goes through a single buffer and a single parse,
+	// syntax errors are recovered at the end of the line.
+	m_errorCount = 0;
+	YY_BUFFER_STATE state = yy_scan_buffer(base, size + 2, m_scanner);
+	int result = parse();
+	yy_delete_buffer(state, m_scanner);
+	munmap(base, mapSize);
+
+	if (result == 0 && m_errorCount > 0)
+		result = 1;
 	return result;
 }
 
+void interpreter::end_of_statement()
+{
+	// an open For/If still refers to its nodes
+	if (m_statementList.empty())
+		m_nodes.reset();
+}
+
+int interpreter::get_version()
+{
+	return BASIC_INTERPRETER_VERSION;
+}
+
 void interpreter::print_version(std::ostream& os)
 {
 	os << "Basic Shell Interpreter Version "
@@ -76,8 +237,10 @@ llvm::Value* interpreter::get_variable(llvm::BasicBlock* bb, const char* pszname
 
 void interpreter::print_module(std::string& buffer)
 {
+	phase_timer timer(m_stats, compile_stats::PHASE_PRINT);
 	raw_string_ostream rso(buffer);
-	module->print(rso, nullptr);
+	if (module)
+		module->print(rso, nullptr);
 }
 
 llvm::Type* interpreter::get_llvm_type(int nId)
@@ -97,7 +260,7 @@ llvm::Type* interpreter::get_llvm_type(int nId)
 	case DOUBLE:
 		return Type::getDoubleTy(*this);
 	case STRING:
-		return Type::getInt8PtrTy(*this);
+		return m_stringType;
 	default:
 		std::cerr << "Invalid BASIC Type: " << nId << ", returning llvm::Void Type (Any)\n";
 		return Type::getVoidTy(*this);
@@ -106,15 +269,34 @@ llvm::Type* interpreter::get_llvm_type(int nId)
 
 void interpreter::quit()
 {
-	IRBuilder<> builder(m_activeBlock);
+	// a single-line If on the last line, without a newline
+	end_of_line();
+	ir_builder builder(m_activeBlock);
 	
 	// jump to exit block on the last
 	// instruction in this block
 	builder.CreateBr(m_exitBlock);
 
-	// and make return void
+	// and make return void, or return 0 for main(),
+	// so the exit status of a native executable is defined
 	builder.SetInsertPoint(m_exitBlock);
-	builder.CreateRetVoid();
+	free_locals(builder);
+	// in incremental mode a Sub may print on behalf of this statement
+	if (m_printUsed || m_incremental)
+		call_runtime(builder, "basic_print_flush", builder.getVoidTy(), {});
+	Type* t = m_exitBlock->getParent()->getReturnType();
+	if (t->isVoidTy())
+		builder.CreateRetVoid();
+	else
+		builder.CreateRet(ConstantInt::get(t, 0));
+
+	// a library only keeps its Subs and Functions,
+	// the statements outside of them are dropped
+	if (m_library)
+	{
+		m_entryBlock->getParent()->eraseFromParent();
+		m_entryBlock = m_exitBlock = m_activeBlock = nullptr;
+	}
 }
 
 Function* interpreter::get_current_function()
@@ -134,85 +316,118 @@ Constant* interpreter::get_constant_double(double d)
 	return ConstantFP::get(Type::getDoubleTy(*this), d);
 }
 
-Value* interpreter::find_variable(const char* pszname)
+bool interpreter::is_variable(Value* pVal)
 {
-	// first, lookup the name in current block
-	Function* f = get_current_function();
-	if (!f->empty())
-	{
-		for (auto iter = f->begin(); iter != f->end(); iter++)
-		{
-			ValueSymbolTable* sym = iter->getValueSymbolTable();
-			if (sym)
-			{
-				Value* pVal = sym->lookup(pszname);
-				if (pVal)
-					return pVal;
-			}
-		}
-	}
-
-	// either f is empty, or the variable is in module level,
-	// or simply wasn't there
-	Value* testValue = module->getGlobalVariable(pszname, true);
-	return testValue;
+	if (m_elements.count(pVal))
+		return true;
+	if (is_array(pVal) || m_stringTemps.count(pVal))
+		return false;
+	if (AllocaInst::classof(pVal))
+		return true;
+	if (GlobalVariable::classof(pVal))
+		return !static_cast<GlobalVariable*>(pVal)->isConstant();
+	return false;
 }
 
-Constant* interpreter::find_function(const char* pszname)
+Type* interpreter::get_variable_type(Value* pVar)
 {
-	return static_cast<Constant*>(module->getFunction(pszname));
+	if (AllocaInst::classof(pVar))
+		return static_cast<AllocaInst*>(pVar)->getAllocatedType();
+	if (GlobalVariable::classof(pVar))
+		return static_cast<GlobalVariable*>(pVar)->getValueType();
+	if (GetElementPtrInst::classof(pVar))
+		return static_cast<GetElementPtrInst*>(pVar)->getResultElementType();
+	return pVar->getType();
 }
 
-Value* interpreter::make_equal_comparison(Value* lhs, Value* rhs)
+Value* interpreter::create_variable(int nType, const char* pszname, BasicBlock* bb)
 {
-	IRBuilder<> builder(m_activeBlock);
-
-	Value* v1 = lhs;
-	Value* v2 = rhs;
-	Type* t1 = lhs->getType();
-	Type* t2 = rhs->getType();
-
-	if (AllocaInst::classof(lhs))
+	symbol* sym = m_symbols.lookup_local(pszname);
+	if (sym)
 	{
-		AllocaInst* p = static_cast<AllocaInst*>(lhs);
-		t1 = p->getAllocatedType();
-		v1 = builder.CreateLoad(lhs);
+		std::cerr << "WARNING: variable " << pszname << " is already defined, the previous definition is used.\n";
+		return find_variable(pszname);
 	}
 
-	if (AllocaInst::classof(rhs))
+	Type* t = get_llvm_type(nType);
+	Value* storage = nullptr;
+	if (m_incremental && m_symbols.depth() == 1)
+	{
+		// must survive between statements, and the globals are linked
+		// by name across modules, so use the same (lower-cased) name
+		// the symbol table uses.
+		std::string strName(pszname);
+		for (auto& c: strName)
+			c = tolower(static_cast<unsigned char>(c));
+		storage = new GlobalVariable(*(module.get()), t, false,
+				GlobalVariable::ExternalLinkage, Constant::getNullValue(t), strName);
+	}
+	else
 	{
-		AllocaInst* p = static_cast<AllocaInst*>(rhs);
-		t2 = p->getAllocatedType();
-		v2 = builder.CreateLoad(rhs);
+		// allocas go first, the block may already have its terminator
+		ir_builder builder(bb, bb->getFirstInsertionPt());
+		storage = builder.CreateAlloca(t, nullptr, pszname);
+		if (t == m_stringType)
+		{
+			// an empty String, released when the function returns
+			builder.CreateStore(Constant::getNullValue(t), storage);
+			m_stringSlots.push_back(storage);
+		}
 	}
 
-	if (t1 != t2)
+	m_symbols.insert(pszname, symbol{ nType, t, storage });
+	return storage;
+}
+
+Value* interpreter::find_variable(const char* pszname)
+{
+	m_stats.count_lookup();
+	symbol* sym = m_symbols.lookup(pszname);
+	if (!sym && m_symbols.depth() > 1)
 	{
-		// dilemma here...
-		// we should check if any of them is constant
-		// and try to compare against the constant type ???
-		auto [p1, p2] = cast_as_needed(v1, v2);
-		if (p1->getType()->isFloatingPointTy())
-			return builder.CreateFCmpOEQ(p1, p2);
-		return builder.CreateICmpEQ(p1, p2);
+		symbol* outer = m_symbols.lookup_global(pszname);
+		if (outer && outer->typeId != SUB && outer->typeId != FUNCTION)
+			std::cerr << "error: " << pszname << " is not defined in this Sub or Function,"
+				<< " the variables of the main program can't be used there.\n";
 	}
+	// Subs and Functions are in the table too, see find_function()
+	if (!sym || sym->typeId == SUB || sym->typeId == FUNCTION)
+		return nullptr;
 
-	if (t1->isFloatingPointTy())
-		return builder.CreateFCmpOEQ(v1, v2);
-	else if (t1->isIntegerTy())
-		return builder.CreateICmpEQ(v1, v2);
+	if (!sym->storage)
+	{
+		// in incremental mode, the variable was defined by one of
+		// the previous statements, which already live in the JIT,
+		// so we only need to declare it in this module.
+		std::string strName(pszname);
+		for (auto& c: strName)
+			c = tolower(static_cast<unsigned char>(c));
+		sym->storage = new GlobalVariable(*(module.get()), sym->type, false,
+				GlobalVariable::ExternalLinkage, nullptr, strName);
+		if (sym->isArray)
+			m_arrays.insert(sym->storage);
+		// a dynamic or a String array keeps its number of elements next to it
+		if (sym->isArray && (sym->typeId == STRING || !sym->isFixed))
+			sym->count = new GlobalVariable(*(module.get()), Type::getInt64Ty(*this), false,
+					GlobalVariable::ExternalLinkage, nullptr, strName + ".count");
+	}
+	return sym->storage;
+}
 
-	return builder.getInt1(false);
+Value* interpreter::make_equal_comparison(Value* lhs, Value* rhs)
+{
+	return make_comparison(lhs, rhs, CmpInst::ICMP_EQ);
 }
 
 Value* interpreter::cast_for_assignment(Value* pVal, Type* pType)
 {
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
 	Type* t = pVal->getType();
 	if (t == pType)
 		return pVal;
+	m_stats.count_cast();
 	if (pType->isFloatingPointTy() && t->isIntegerTy())
-		return builder.CreateSIToFP(pVal, pType);
+		return is_signed_type(t) ? builder.CreateSIToFP(pVal, pType) : builder.CreateUIToFP(pVal, pType);
 	else if (pType->isIntegerTy() && t->isFloatingPointTy())
 		return builder.CreateFPToSI(pVal, pType);
 	
@@ -226,41 +441,31 @@ Value* interpreter::cast_for_assignment(Value* pVal, Type* pType)
 		// otherwise, we just extent/truncate the value
 		if (t->getScalarSizeInBits() > pType->getScalarSizeInBits())
 			return builder.CreateTrunc(pVal, pType);
-		return builder.CreateZExt(pVal, pType);
-	}
-	else if (t->isArrayTy())
-	{
-		std::cerr << "Warning: casting array type is not currently supported.\n"
-			<< "Treating the array as an array of characters (String)\n";
-		// try to take the address of array[0][0]
-		// and return it
-		// The string must be in Global space, but it can be internal
-		GlobalVariable* gv = new GlobalVariable(*(module.get()), t, true, 
-				GlobalVariable::InternalLinkage, static_cast<Constant*>(pVal));
-		Value* zero = builder.getInt32(0);
-		Value* idx[] = { zero, zero };
-		Value* retVal = builder.CreateInBoundsGEP(t, gv, ArrayRef<Value*>(idx));
-		std::string strDebug("GlobalString => ");
-		raw_string_ostream rso(strDebug);
-		gv->print(rso);
-		std::cerr << strDebug << "\n";
-		return retVal;
+		return builder.CreateIntCast(pVal, pType, is_signed_type(t));
 	}
 	return pVal;
 }
 
 Value* interpreter::assign_variable(Value* pVar, Value* pVal)
 {
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
 
 	// we filter out the possibilities of getting error here
-	if (AllocaInst::classof(pVar))
+	if (is_variable(pVar))
 	{
+		Type* allocatedType = get_variable_type(pVar);
+		if (allocatedType == m_stringType)
+			return assign_string(pVar, pVal);
+
 		Value* rhs = pVal;
-		if (AllocaInst::classof(pVal))
+		if (is_string(pVal))
+		{
+			std::cerr << "error: type mismatch, a String cannot be assigned to a number\n";
+			add_error();
+			return pVal;
+		}
+		if (is_variable(pVal))
 			rhs = builder.CreateLoad(pVal);
-		
-		Type* allocatedType = static_cast<AllocaInst*>(pVar)->getAllocatedType();
 		rhs = cast_for_assignment(rhs, allocatedType);
 		return builder.CreateStore(rhs, pVar);
 	}
@@ -272,35 +477,20 @@ Value* interpreter::assign_variable(Value* pVar, Value* pVal)
 	return pVal;
 }
 
-Value* interpreter::make_return_value(Constant* fn, Value* pVal)
-{
-	Function* f = static_cast<Function*>(fn);
-	Type* ret = f->getReturnType();
-	Value* rhs = pVal;
-
-	BasicBlock* bb = nullptr;
-	if (f->empty())
-	{
-		// it is possible
-		bb = BasicBlock::Create(*this, "", f);
-	}
-	else
-		bb = &(f->getEntryBlock());
-
-	IRBuilder<> builder(bb);
-	if (AllocaInst::classof(pVal))
-		rhs = builder.CreateLoad(pVal);
-	return builder.CreateRet(rhs);
-}
-
 Value* interpreter::make_add(Value* lhs, Value* rhs)
 {
 	// have to change this style as soon as we mess with IF
-	IRBuilder<> builder(m_activeBlock);
-	if (lhs->getType() == rhs->getType())
-		return builder.CreateAdd(lhs, rhs);
+	if (is_string(lhs) || is_string(rhs))
+		return make_concat(lhs, rhs);
+	ir_builder builder(m_activeBlock);
 	auto [p1, p2] = cast_as_needed(lhs, rhs);
-	return builder.CreateAdd(p1, p2);
+	bool bFloat = p1->getType()->isFloatingPointTy();
+	Value* pFolded = fold_binary(bFloat ? Instruction::FAdd : Instruction::Add, p1, p2);
+	if (pFolded)
+		return pFolded;
+	if (bFloat)
+		return builder.CreateFAdd(p1, p2);
+	return make_int_arith(Instruction::Add, p1, p2);
 }
 
 // maintain compatibility with earlier version
@@ -316,29 +506,45 @@ void interpreter::set_current_block(BasicBlock* bb)
 
 Value* interpreter::make_subtract(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
-	if (lhs->getType() == rhs->getType())
-		return builder.CreateSub(lhs, rhs);
-
+	ir_builder builder(m_activeBlock);
 	auto [p1, p2] = cast_as_needed(lhs, rhs);
-	return builder.CreateSub(p1, p2);
+	bool bFloat = p1->getType()->isFloatingPointTy();
+	Value* pFolded = fold_binary(bFloat ? Instruction::FSub : Instruction::Sub, p1, p2);
+	if (pFolded)
+		return pFolded;
+	if (bFloat)
+		return builder.CreateFSub(p1, p2);
+	return make_int_arith(Instruction::Sub, p1, p2);
 }
 
 Value* interpreter::make_mult(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
 	auto [p1, p2] = cast_as_needed(lhs, rhs);
 	Type* t = p1->getType();
+	Value* pFolded = fold_binary(t->isFloatingPointTy() ? Instruction::FMul : Instruction::Mul, p1, p2);
+	if (pFolded)
+		return pFolded;
 	if (t->isFloatingPointTy())
 		return builder.CreateFMul(p1, p2);
-	return builder.CreateMul(p1, p2);
+	return make_int_arith(Instruction::Mul, p1, p2);
 }
 
 Value* interpreter::make_divide(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
 	auto [p1, p2] = cast_as_needed(lhs, rhs);
 	Type* t = p1->getType();
+	if (t->isIntegerTy() && ConstantInt::classof(p2) && static_cast<ConstantInt*>(p2)->isZero())
+	{
+		// the constant folder would turn it into undef
+		std::cerr << "error: division by zero\n";
+		add_error();
+		return p2;
+	}
+	Value* pFolded = fold_binary(t->isFloatingPointTy() ? Instruction::FDiv : Instruction::SDiv, p1, p2);
+	if (pFolded)
+		return pFolded;
 	if (t->isFloatingPointTy())
 		return builder.CreateFDiv(p1, p2);
 	return builder.CreateSDiv(p1, p2);
@@ -346,28 +552,12 @@ Value* interpreter::make_divide(Value* lhs, Value* rhs)
 
 Value* interpreter::make_compare_less_than(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
-	auto [p1, p2] = cast_as_needed(lhs, rhs);
-	Type* t = p1->getType();
-	if (t->isFloatingPointTy())
-	{
-		// slightly different
-		return builder.CreateFCmpOLT(p1, p2);
-	}
-	return builder.CreateICmpSLT(p1, p2);
+	return make_comparison(lhs, rhs, CmpInst::ICMP_SLT);
 }
 
 Value* interpreter::make_compare_greater_than(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
-	auto [p1, p2] = cast_as_needed(lhs, rhs);
-	Type* t = p1->getType();
-	if (t->isFloatingPointTy())
-	{
-		// slightly different
-		return builder.CreateFCmpOGT(p1, p2);
-	}
-	return builder.CreateICmpSGT(p1, p2);
+	return make_comparison(lhs, rhs, CmpInst::ICMP_SGT);
 }
 
 Value* interpreter::cast_to_double(Value* pVal)
@@ -376,28 +566,50 @@ Value* interpreter::cast_to_double(Value* pVal)
 	if (t->isDoubleTy())
 		return pVal;
 
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
 
 	Value* pRes = pVal;
-	if (AllocaInst::classof(pVal))
+	if (is_variable(pVal))
 	{
-		AllocaInst* inst = static_cast<AllocaInst*>(pVal);
-		t = inst->getAllocatedType();
+		t = get_variable_type(pVal);
 		pRes = builder.CreateLoad(pVal);
 	}
 	if (t->isDoubleTy())
 		return pRes;
+	m_stats.count_cast();
 	if (t->isFloatingPointTy())
 		return builder.CreateFPCast(pRes, builder.getDoubleTy());
 	else if (t->isIntegerTy())
-		return builder.CreateUIToFP(pRes, builder.getDoubleTy());
+		return is_signed_type(t) ? builder.CreateSIToFP(pRes, builder.getDoubleTy())
+			: builder.CreateUIToFP(pRes, builder.getDoubleTy());
 	std::cerr << "WARNING: dont know how to cast the value to double.\n";
 	return pRes;
 }
 
 Value* interpreter::make_pow(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
+	Value* pFolded = fold_pow(lhs, rhs);
+	if (pFolded)
+		return pFolded;
+
+	ir_builder builder(m_activeBlock);
+	Type* baseType = is_variable(lhs) ? get_variable_type(lhs) : lhs->getType();
+	Type* expType = is_variable(rhs) ? get_variable_type(rhs) : rhs->getType();
+	if (baseType->isIntegerTy() && expType->isIntegerTy()
+			&& !baseType->isIntegerTy(1) && !expType->isIntegerTy(1))
+	{
+		// integer ^ integer stays an integer, in the wider of the
+		// two types, folded or not
+		Type* t = baseType->getIntegerBitWidth() >= expType->getIntegerBitWidth() ? baseType : expType;
+		Value* pBase = is_variable(lhs) ? builder.CreateLoad(lhs) : lhs;
+		Value* pExp = is_variable(rhs) ? builder.CreateLoad(rhs) : rhs;
+		Type* i64 = builder.getInt64Ty();
+		Value* args[] = { builder.CreateIntCast(pBase, i64, is_signed_type(baseType)),
+			builder.CreateIntCast(pExp, i64, is_signed_type(expType)) };
+		Value* pResult = call_runtime(builder, "basic_pow_long", i64, args);
+		return builder.CreateIntCast(pResult, t, true);
+	}
+
 	Type* dt = builder.getDoubleTy();
 	Type* argTypes[] = { dt, dt };
 	Constant* fn = module->getOrInsertFunction("pow",
@@ -410,25 +622,32 @@ Value* interpreter::make_pow(Value* lhs, Value* rhs)
 
 std::tuple<llvm::Value*, llvm::Value*> interpreter::cast_as_needed(Value* lhs, Value* rhs)
 {
-	IRBuilder<> builder(m_activeBlock);
+	ir_builder builder(m_activeBlock);
+
+	if (is_string(lhs) || is_string(rhs))
+	{
+		// only & and the comparisons take Strings
+		std::cerr << "error: type mismatch, a String is not a number\n";
+		add_error();
+		Value* zero = builder.getInt64(0);
+		return std::tuple<Value*, Value*>(zero, zero);
+	}
 
 	Value* pLHS = lhs;
 	Value* pRHS = rhs;
 	Type* lhsType = pLHS->getType();
 	Type* rhsType = pRHS->getType();
 
-	if (AllocaInst::classof(lhs))
+	if (is_variable(lhs))
 	{
-		AllocaInst* pInst = static_cast<AllocaInst*>(lhs);
-		lhsType = pInst->getAllocatedType();
+		lhsType = get_variable_type(lhs);
 		pLHS = builder.CreateLoad(lhs);
 	}
 
-	if (AllocaInst::classof(rhs))
+	if (is_variable(rhs))
 	{
-		AllocaInst* pInst = static_cast<AllocaInst*>(rhs);
 		pRHS = builder.CreateLoad(rhs);
-		rhsType = pInst->getAllocatedType();
+		rhsType = get_variable_type(rhs);
 	}
 
 	if (lhsType == rhsType)
@@ -438,13 +657,16 @@ std::tuple<llvm::Value*, llvm::Value*> interpreter::cast_as_needed(Value* lhs, V
 		return std::tuple<Value*, Value*>(pLHS, pRHS);
 	}
 
+	m_stats.count_cast();
+
 	// start with LHS
 	if (lhsType->isIntegerTy())
 	{
 		if (rhsType->isFloatingPointTy())
 		{
 			// cast the LHS into RHS float type
-			pLHS = builder.CreateUIToFP(pLHS, rhsType);
+			pLHS = is_signed_type(lhsType) ? builder.CreateSIToFP(pLHS, rhsType)
+				: builder.CreateUIToFP(pLHS, rhsType);
 			return std::tuple<Value*, Value*>(pLHS, pRHS);
 		}
 
@@ -459,13 +681,12 @@ std::tuple<llvm::Value*, llvm::Value*> interpreter::cast_as_needed(Value* lhs, V
 			return std::tuple<Value*, Value*>(lhs, rhs);
 		}
 
-		// If we got here, then RHS is also integer
-		// Test the 'true' sign flags first
-		// If we got something weird, then we change the following.
+		// If we got here, then RHS is also integer,
+		// the narrower one is extended by its own signedness
 		if (lhsType->getScalarSizeInBits() < rhsType->getScalarSizeInBits())
-			pLHS = builder.CreateIntCast(pLHS, rhsType, true);
+			pLHS = builder.CreateIntCast(pLHS, rhsType, is_signed_type(lhsType));
 		else if (lhsType->getScalarSizeInBits() > rhsType->getScalarSizeInBits())
-			pRHS = builder.CreateIntCast(pRHS, lhsType, true);
+			pRHS = builder.CreateIntCast(pRHS, lhsType, is_signed_type(rhsType));
 
 		return std::tuple<Value*, Value*>(pLHS, pRHS);
 	}
@@ -474,7 +695,8 @@ std::tuple<llvm::Value*, llvm::Value*> interpreter::cast_as_needed(Value* lhs, V
 		if (rhsType->isIntegerTy())
 		{
 			// upcast the integer into floating-point of LHS type
-			pRHS = builder.CreateUIToFP(pRHS, lhsType);
+			pRHS = is_signed_type(rhsType) ? builder.CreateSIToFP(pRHS, lhsType)
+				: builder.CreateUIToFP(pRHS, lhsType);
 			return std::tuple<Value*, Value*>(pLHS, pRHS);
 		}
 
@@ -487,22 +709,18 @@ std::tuple<llvm::Value*, llvm::Value*> interpreter::cast_as_needed(Value* lhs, V
 		// So one of them must be bigger.
 		//
 		if (!lhsType->isDoubleTy())
-		{
-			std::cerr << "cast LHS type info double\n";
 			pLHS = builder.CreateFPExt(pLHS, rhsType);
-		}
 		else if (!rhsType->isDoubleTy())
-		{
-			std::cerr << "cast RHS type info double\n";
 			pRHS = builder.CreateFPExt(pRHS, lhsType);
-		}
 		
-		std::string strCast("floating-point CAST\n=> ");
-		raw_string_ostream rso(strCast);
-		pLHS->print(rso);
-		rso << "\n=> ";
-		pRHS->print(rso);
-		std::cerr << strCast << "\n";
+		BASIC_TRACE(TRACE_CASTS, 1, {
+			std::string strCast("floating-point CAST\n=> ");
+			raw_string_ostream rso(strCast);
+			pLHS->print(rso);
+			rso << "\n=> ";
+			pRHS->print(rso);
+			trace::write(rso.str());
+		});
 	}
 
 	return std::tuple<Value*, Value*>(pLHS, pRHS);
@@ -550,3 +768,26 @@ for_stmt* interpreter::find_last_for(const char* strId)
 	return nullptr;
 }
 
+if_stmt* interpreter::last_if()
+{
+	statement* pObj = last_context();
+	if (pObj && (pObj->type() == IF || pObj->type() == ELSEIF || pObj->type() == ELSE))
+		return static_cast<if_stmt*>(pObj);
+	return nullptr;
+}
+
+select_stmt* interpreter::last_select()
+{
+	statement* pObj = last_context();
+	if (pObj && pObj->type() == SELECT)
+		return static_cast<select_stmt*>(pObj);
+	return nullptr;
+}
+
+do_stmt* interpreter::last_do()
+{
+	statement* pObj = last_context();
+	if (pObj && pObj->type() == DO)
+		return static_cast<do_stmt*>(pObj);
+	return nullptr;
+}
@@ -0,0 +1,204 @@
+#include "basic.h"
+#include "runtime.h"
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Support/Error.h>
+#include <chrono>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// In-process execution of the module built by the interpreter,
+// so we don't have to go through lli or llc anymore.
+/////////////////////////////////////////////////////////////////////////
+
+orc::LLJIT* interpreter::get_jit()
+{
+	if (m_jit)
+		return m_jit.get();
+
+	init_native_target();
+
+	auto jtmb = orc::JITTargetMachineBuilder::detectHost();
+	if (!jtmb)
+	{
+		logAllUnhandledErrors(jtmb.takeError(), errs(), "basic: JIT: ");
+		return nullptr;
+	}
+
+	auto dl = jtmb->getDefaultDataLayoutForTarget();
+	if (!dl)
+	{
+		logAllUnhandledErrors(dl.takeError(), errs(), "basic: JIT: ");
+		return nullptr;
+	}
+
+	auto jit = orc::LLJIT::Create(std::move(*jtmb), std::move(*dl));
+	if (!jit)
+	{
+		logAllUnhandledErrors(jit.takeError(), errs(), "basic: JIT: ");
+		return nullptr;
+	}
+	m_jit = std::move(*jit);
+
+	// external functions like puts and pow are resolved
+	// from the host process
+	auto gen = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(m_jit->getDataLayout());
+	if (!gen)
+	{
+		logAllUnhandledErrors(gen.takeError(), errs(), "basic: JIT: ");
+		m_jit.reset();
+		return nullptr;
+	}
+	m_jit->getMainJITDylib().setGenerator(std::move(*gen));
+	return m_jit.get();
+}
+
+void* interpreter::jit_compile(const char* fnName)
+{
+	if (!module)
+	{
+		std::cerr << "basic: JIT: the module has already been handed over to the JIT.\n";
+		return nullptr;
+	}
+
+	orc::LLJIT* jit = get_jit();
+	if (!jit)
+		return nullptr;
+
+	auto t0 = std::chrono::steady_clock::now();
+
+	module->setDataLayout(jit->getDataLayout());
+
+	// the JIT shares the context the module was built in, the
+	// modules it keeps are released with the JIT, before we are
+	if (Error err = jit->addIRModule(orc::ThreadSafeModule(std::move(module), m_context)))
+	{
+		logAllUnhandledErrors(std::move(err), errs(), "basic: JIT: ");
+		return nullptr;
+	}
+
+	// looking up the symbol is what actually triggers the compilation
+	auto sym = jit->lookup(fnName);
+	if (!sym)
+	{
+		logAllUnhandledErrors(sym.takeError(), errs(), "basic: JIT: ");
+		return nullptr;
+	}
+
+	auto t1 = std::chrono::steady_clock::now();
+	m_compileTime = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	m_stats.add_time(compile_stats::PHASE_JIT, m_compileTime / 1000.0);
+	return reinterpret_cast<void*>(static_cast<intptr_t>(sym->getAddress()));
+}
+
+int interpreter::execute(void* pfn, bool bMain)
+{
+	int result = 0;
+	jmp_buf jump;
+	auto t0 = std::chrono::steady_clock::now();
+	basic_set_error_jump(&jump);
+	if (setjmp(jump) == 0)
+	{
+		if (bMain)
+			reinterpret_cast<int (*)()>(pfn)();
+		else
+			reinterpret_cast<void (*)()>(pfn)();
+	}
+	else
+		result = -1;
+	basic_set_error_jump(nullptr);
+	auto t1 = std::chrono::steady_clock::now();
+
+	m_executeTime = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	m_stats.add_time(compile_stats::PHASE_EXECUTE, m_executeTime / 1000.0);
+	return result;
+}
+
+int interpreter::run()
+{
+	void* pfn = jit_compile("main");
+	if (!pfn)
+		return -1;
+	return execute(pfn, true);
+}
+
+int interpreter::run_object(std::unique_ptr<MemoryBuffer> obj)
+{
+	orc::LLJIT* jit = get_jit();
+	if (!jit)
+		return -1;
+
+	// already compiled, the JIT only has to link it
+	auto t0 = std::chrono::steady_clock::now();
+	if (Error err = jit->addObjectFile(std::move(obj)))
+	{
+		logAllUnhandledErrors(std::move(err), errs(), "basic: JIT: ");
+		return -1;
+	}
+	auto sym = jit->lookup("main");
+	if (!sym)
+	{
+		logAllUnhandledErrors(sym.takeError(), errs(), "basic: JIT: ");
+		return -1;
+	}
+	auto t1 = std::chrono::steady_clock::now();
+	m_compileTime = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	m_stats.add_time(compile_stats::PHASE_JIT, m_compileTime / 1000.0);
+
+	return execute(reinterpret_cast<void*>(static_cast<intptr_t>(sym->getAddress())), true);
+}
+
+int interpreter::run_statement()
+{
+	// a For or If block is still open,
+	// it will run as a whole when the block is closed.
+	if (!is_statement_complete())
+		return 0;
+
+	// nothing was emitted (empty line, or a failed statement),
+	// a Sub or Function definition leaves the statement itself empty
+	bool bEmpty = m_entryBlock->empty() && m_activeBlock == m_entryBlock && module->global_empty();
+	for (auto& fn: *module)
+	{
+		if (!fn.isDeclaration() && &fn != m_entryBlock->getParent())
+			bEmpty = false;
+	}
+	if (bEmpty)
+		return 0;
+
+	std::string fnName = get_current_function()->getName();
+	quit();
+	// invalid IR is not handed to the JIT
+	void* pfn = nullptr;
+	if (optimize())
+		pfn = jit_compile(fnName.c_str());
+
+	// the next statement always starts with a fresh module,
+	// even if this one failed to compile
+	next_chunk();
+	if (!pfn)
+		return -1;
+
+	return execute(pfn, false);
+}
+
+void interpreter::discard_statement()
+{
+	// an open Sub or Function, without its epilogue
+	while (!m_functions.empty())
+	{
+		m_symbols.pop_scope();
+		m_functions.pop_front();
+	}
+	m_heapArrays.clear();
+	m_stringArrays.clear();
+	m_stringSlots.clear();
+	m_mainHeapArrays.clear();
+	m_mainStringArrays.clear();
+	m_mainStringSlots.clear();
+	m_statementList.clear();
+	end_of_statement();
+	m_symbols.drop_new_globals();
+	next_chunk();
+}
@@ -0,0 +1,160 @@
+#ifndef BASIC_KEYWORDS_H
+#define BASIC_KEYWORDS_H
+
+// Keyword recognition for the lexer.
+// Must be included after parser.hpp, we need the token values.
+//
+// The table is a perfect hash generated at compile time: we search
+// for a seed that maps every keyword into its own slot, so looking up
+// an identifier costs one hash, and at most one string comparison.
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+
+namespace basic
+{
+	struct keyword
+	{
+		const char* name;   // lower case
+		size_t length;
+		int token;          // returned to the parser
+		int typeID;         // semantic value (yylval->typeID)
+	};
+
+	constexpr char keyword_lower(char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
+	}
+
+	constexpr size_t keyword_strlen(const char* s)
+	{
+		size_t n = 0;
+		while (s[n])
+			n++;
+		return n;
+	}
+
+	constexpr keyword make_keyword(const char* name, int token, int typeID)
+	{
+		return keyword{ name, keyword_strlen(name), token, typeID };
+	}
+
+	constexpr keyword keyword_list[] = {
+		make_keyword("dim", DIM, DIM),
+		make_keyword("sub", SUB, SUB),
+		make_keyword("function", FUNCTION, FUNCTION),
+		make_keyword("as", AS, AS),
+		make_keyword("if", IF, IF),
+		make_keyword("else", ELSE, ELSE),
+		make_keyword("elseif", ELSEIF, ELSEIF),
+		make_keyword("endif", ENDIF, ENDIF),
+		make_keyword("then", THEN, THEN),
+		make_keyword("for", FOR, FOR),
+		make_keyword("each", EACH, EACH),
+		make_keyword("to", TO, TO),
+		make_keyword("step", STEP, STEP),
+		make_keyword("next", NEXT, NEXT),
+		make_keyword("end", END, END),
+		make_keyword("redim", REDIM, REDIM),
+		make_keyword("exit", EXIT, EXIT),
+		make_keyword("print", PRINT, PRINT),
+		make_keyword("select", SELECT, SELECT),
+		make_keyword("case", CASE, CASE),
+		make_keyword("do", DO, DO),
+		make_keyword("loop", LOOP, LOOP),
+		make_keyword("while", WHILE, WHILE),
+		make_keyword("until", UNTIL, UNTIL),
+		make_keyword("continue", CONTINUE, CONTINUE),
+		// operators
+		make_keyword("and", AND, AND),
+		make_keyword("or", OR, OR),
+		make_keyword("xor", XOR, XOR),
+		make_keyword("not", NOT, NOT),
+		make_keyword("andalso", ANDALSO, ANDALSO),
+		make_keyword("orelse", ORELSE, ORELSE),
+		// type names
+		make_keyword("byte", TYPEID, BYTE),
+		make_keyword("boolean", TYPEID, BOOLEAN),
+		make_keyword("integer", TYPEID, INTEGER),
+		make_keyword("long", TYPEID, LONG),
+		make_keyword("single", TYPEID, SINGLE),
+		make_keyword("double", TYPEID, DOUBLE),
+		make_keyword("string", TYPEID, STRING),
+	};
+
+	constexpr size_t KEYWORD_COUNT = std::size(keyword_list);
+	constexpr size_t KEYWORD_TABLE_SIZE = 256;
+	constexpr size_t KEYWORD_MAX_LENGTH = 16;
+
+	// FNV-1a over the lower-cased name, folded into the table size
+	constexpr size_t keyword_hash(const char* s, size_t len, unsigned seed)
+	{
+		unsigned h = 2166136261u ^ seed;
+		for (size_t i = 0; i < len; i++)
+		{
+			h ^= static_cast<unsigned char>(keyword_lower(s[i]));
+			h *= 16777619u;
+		}
+		return (h ^ (h >> 16)) & (KEYWORD_TABLE_SIZE - 1);
+	}
+
+	constexpr bool keyword_seed_is_perfect(unsigned seed)
+	{
+		bool used[KEYWORD_TABLE_SIZE] = {};
+		for (size_t i = 0; i < KEYWORD_COUNT; i++)
+		{
+			size_t slot = keyword_hash(keyword_list[i].name, keyword_list[i].length, seed);
+			if (used[slot])
+				return false;
+			used[slot] = true;
+		}
+		return true;
+	}
+
+	constexpr unsigned find_keyword_seed()
+	{
+		for (unsigned seed = 0; seed < 100000; seed++)
+		{
+			if (keyword_seed_is_perfect(seed))
+				return seed;
+		}
+		return ~0u;
+	}
+
+	constexpr unsigned KEYWORD_SEED = find_keyword_seed();
+	static_assert(KEYWORD_SEED != ~0u, "no perfect hash for the keyword table, increase KEYWORD_TABLE_SIZE");
+
+	// slot -> index into keyword_list + 1, 0 means empty
+	constexpr std::array<unsigned char, KEYWORD_TABLE_SIZE> make_keyword_table()
+	{
+		std::array<unsigned char, KEYWORD_TABLE_SIZE> table{};
+		for (size_t i = 0; i < KEYWORD_COUNT; i++)
+			table[keyword_hash(keyword_list[i].name, keyword_list[i].length, KEYWORD_SEED)] =
+				static_cast<unsigned char>(i + 1);
+		return table;
+	}
+
+	constexpr std::array<unsigned char, KEYWORD_TABLE_SIZE> keyword_table = make_keyword_table();
+
+	// returns nullptr if the text is not a keyword
+	inline const keyword* find_keyword(const char* text, size_t len)
+	{
+		if (len > KEYWORD_MAX_LENGTH)
+			return nullptr;
+		unsigned char idx = keyword_table[keyword_hash(text, len, KEYWORD_SEED)];
+		if (!idx)
+			return nullptr;
+		const keyword* kw = &keyword_list[idx - 1];
+		if (kw->length != len)
+			return nullptr;
+		for (size_t i = 0; i < len; i++)
+		{
+			if (keyword_lower(text[i]) != kw->name[i])
+				return nullptr;
+		}
+		return kw;
+	}
+}
+
+#endif /* BASIC_KEYWORDS_H */
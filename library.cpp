@@ -0,0 +1,125 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/SHA1.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Precompiled libraries
+//
+// basic --library --emit=bc strings.bas     -> strings.bc
+// basic -l strings.bc prog.bas
+//
+// A library is the bitcode of a source with only Subs and Functions,
+// compiled with external linkage and without main(). Using it only
+// reads its symbol table: the procedures are declared to the parser,
+// and once the program is complete the library is linked with
+// LinkOnlyNeeded, so only the bodies that are called (directly or not)
+// are read from the bitcode. They are internal afterwards, the
+// optimizer can inline them like our own.
+/////////////////////////////////////////////////////////////////////////
+
+void interpreter::set_library(bool bLibrary)
+{
+	m_library = bLibrary;
+}
+
+// the lazy module got its own copy of the named types, the String
+// parameters must look like ours to make_call()
+static Type* map_library_type(Type* t, StructType* pString)
+{
+	if (t->isPointerTy() && t->getPointerElementType()->isStructTy())
+	{
+		StructType* st = static_cast<StructType*>(t->getPointerElementType());
+		if (st->hasName() && st->getName().startswith("basic.string"))
+			return pString->getPointerTo();
+	}
+	return t;
+}
+
+bool interpreter::load_library(const char* pszPath)
+{
+	auto buffer = MemoryBuffer::getFile(pszPath);
+	if (!buffer)
+	{
+		std::cerr << "basic: cannot open " << pszPath << ": " << buffer.getError().message() << "\n";
+		return false;
+	}
+
+	// only the symbol table and the prototypes are read here
+	auto lib = getLazyBitcodeModule((*buffer)->getMemBufferRef(), *this);
+	if (!lib)
+	{
+		logAllUnhandledErrors(lib.takeError(), errs(), "basic: " + std::string(pszPath) + ": ");
+		return false;
+	}
+
+	for (auto& fn: **lib)
+	{
+		// the bodies are still in the bitcode, so they are not declarations
+		if (fn.isDeclaration() || !fn.getName().startswith("basic."))
+			continue;
+		std::string strName = fn.getName().substr(6).str();
+		if (m_symbols.lookup_global(strName.c_str()))
+		{
+			std::cerr << "error: " << strName << " from " << pszPath << " is already defined.\n";
+			continue;
+		}
+		FunctionType* ft = fn.getFunctionType();
+		SmallVector<Type*, 8> params;
+		for (auto t: ft->params())
+			params.push_back(map_library_type(t, m_stringType));
+		ft = FunctionType::get(ft->getReturnType(), params, ft->isVarArg());
+		int tok = ft->getReturnType()->isVoidTy() && !fn.hasStructRetAttr() ? SUB : FUNCTION;
+		// the declaration keeps the attributes, sret tells make_call()
+		// about a String result
+		Function* decl = Function::Create(ft, Function::ExternalLinkage, fn.getName(), module.get());
+		decl->setCallingConv(fn.getCallingConv());
+		decl->setAttributes(fn.getAttributes());
+		m_symbols.insert(strName.c_str(), symbol{ tok, ft, decl });
+	}
+
+	// a different library is a different program, for the compile cache
+	SHA1 hash;
+	hash.update((*buffer)->getBuffer());
+	m_libraryKey += " -l" + toHex(hash.final(), true);
+
+	m_libraryBuffers.push_back(std::move(*buffer));
+	m_libraries.push_back(std::move(*lib));
+	return true;
+}
+
+bool interpreter::link_libraries()
+{
+	// a library being compiled keeps the ones it uses apart,
+	// or a program using both would get the procedures twice
+	if (m_library || m_libraries.empty() || !module)
+		return true;
+
+	phase_timer timer(m_stats, compile_stats::PHASE_LINK);
+	// the last one first: what it needs from the libraries
+	// given before it is then linked in with them
+	bool bOk = true;
+	while (!m_libraries.empty())
+	{
+		std::unique_ptr<Module> lib = std::move(m_libraries.back());
+		m_libraries.pop_back();
+		if (Linker::linkModules(*module, std::move(lib), Linker::LinkOnlyNeeded))
+		{
+			std::cerr << "basic: cannot link the libraries\n";
+			bOk = false;
+		}
+	}
+
+	// ours now, the optimizer may inline them or drop them
+	for (auto& fn: *module)
+	{
+		if (!fn.isDeclaration() && fn.getName().startswith("basic."))
+			fn.setLinkage(GlobalValue::InternalLinkage);
+	}
+	return bOk;
+}
@@ -0,0 +1,173 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/Analysis/ValueTracking.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Comparisons and logical operators
+//
+// =, <>, <, <=, > and >= give a Boolean (i1). And, Or, Xor and Not are
+// bitwise like in the other BASICs, so on Booleans they are the logical
+// operators, but both sides are always evaluated. AndAlso and OrElse
+// only evaluate the right side when they need it: it goes into a block
+// of its own, unless it is a few instructions that can run anyway, then
+// both sides are computed and combined with a select, without a branch.
+/////////////////////////////////////////////////////////////////////////
+
+// the ordered predicates, a NaN is only <> anything
+static CmpInst::Predicate fp_predicate(CmpInst::Predicate pred)
+{
+	switch (pred)
+	{
+	case CmpInst::ICMP_EQ:  return CmpInst::FCMP_OEQ;
+	case CmpInst::ICMP_NE:  return CmpInst::FCMP_UNE;
+	case CmpInst::ICMP_SLT: return CmpInst::FCMP_OLT;
+	case CmpInst::ICMP_SLE: return CmpInst::FCMP_OLE;
+	case CmpInst::ICMP_SGT: return CmpInst::FCMP_OGT;
+	case CmpInst::ICMP_SGE: return CmpInst::FCMP_OGE;
+	default: break;
+	}
+	return pred;
+}
+
+Value* interpreter::make_comparison(Value* lhs, Value* rhs, CmpInst::Predicate pred)
+{
+	if (is_string(lhs) || is_string(rhs))
+		return make_string_compare(lhs, rhs, pred);
+
+	auto [p1, p2] = cast_as_needed(lhs, rhs);
+	ir_builder builder(m_activeBlock);
+	Type* t = p1->getType();
+	if (t->isFloatingPointTy())
+		return builder.CreateFCmp(fp_predicate(pred), p1, p2);
+	// Boolean and Byte
+	if (!is_signed_type(t))
+		pred = ICmpInst::getUnsignedPredicate(pred);
+	return builder.CreateICmp(pred, p1, p2);
+}
+
+// the operand of a bitwise operator, a Single/Double is truncated
+static Value* to_integer(interpreter* pInterp, Value* pVal, ir_builder& builder)
+{
+	if (!pVal->getType()->isFloatingPointTy())
+		return pVal;
+	pInterp->get_stats().count_cast();
+	return builder.CreateFPToSI(pVal, builder.getInt64Ty());
+}
+
+Value* interpreter::make_logical(Instruction::BinaryOps op, Value* lhs, Value* rhs)
+{
+	auto [p1, p2] = cast_as_needed(lhs, rhs);
+	ir_builder builder(m_activeBlock);
+	return builder.CreateBinOp(op, to_integer(this, p1, builder), to_integer(this, p2, builder));
+}
+
+Value* interpreter::make_not(Value* pVal)
+{
+	ir_builder builder(m_activeBlock);
+	if (is_string(pVal))
+	{
+		std::cerr << "error: type mismatch, Not needs a number\n";
+		add_error();
+		return builder.getFalse();
+	}
+	if (is_variable(pVal))
+		pVal = builder.CreateLoad(pVal);
+	return builder.CreateNot(to_integer(this, pVal, builder));
+}
+
+// the condition of a branch must be i1,
+// anything else is true when it is not zero
+Value* interpreter::make_condition(Value* pVal, ir_builder& builder)
+{
+	if (is_string(pVal))
+	{
+		std::cerr << "error: type mismatch, a String is not a condition\n";
+		add_error();
+		return builder.getFalse();
+	}
+	Type* t = pVal->getType();
+	if (is_variable(pVal))
+	{
+		t = get_variable_type(pVal);
+		pVal = builder.CreateLoad(pVal);
+	}
+	if (t->isIntegerTy(1))
+		return pVal;
+	if (t->isFloatingPointTy())
+		return builder.CreateFCmpUNE(pVal, ConstantFP::get(t, 0.0));
+	return builder.CreateIsNotNull(pVal);
+}
+
+short_circuit* interpreter::begin_short_circuit(Value* lhs, bool bAndAlso)
+{
+	ir_builder builder(m_activeBlock);
+	short_circuit* sc = create<short_circuit>();
+	sc->lhs = make_condition(lhs, builder);
+	sc->lhsBlock = m_activeBlock;
+	sc->rhsBlock = BasicBlock::Create(*this, bAndAlso ? "andalso" : "orelse", m_activeBlock->getParent());
+	sc->bAndAlso = bAndAlso;
+	// the right side is built in there
+	m_activeBlock = sc->rhsBlock;
+	return sc;
+}
+
+bool basic::is_speculatable(BasicBlock::iterator begin, BasicBlock::iterator end)
+{
+	unsigned nCount = 0;
+	for (auto it = begin; it != end; ++it)
+	{
+		if (!isSafeToSpeculativelyExecute(&*it) || ++nCount > MAX_SPECULATED)
+			return false;
+	}
+	return true;
+}
+
+Value* interpreter::end_short_circuit(short_circuit* sc, Value* rhs)
+{
+	BasicBlock* rhsEnd = m_activeBlock;
+	ir_builder builder(rhsEnd);
+	Value* pRHS = make_condition(rhs, builder);
+
+	// a > 0 AndAlso b > 0: evaluate both, and select
+	if (rhsEnd == sc->rhsBlock && is_speculatable(rhsEnd->begin(), rhsEnd->end()))
+	{
+		sc->lhsBlock->getInstList().splice(sc->lhsBlock->end(), rhsEnd->getInstList());
+		rhsEnd->eraseFromParent();
+		m_activeBlock = sc->lhsBlock;
+		builder.SetInsertPoint(m_activeBlock);
+		if (sc->bAndAlso)
+			return builder.CreateSelect(sc->lhs, pRHS, builder.getFalse());
+		return builder.CreateSelect(sc->lhs, builder.getTrue(), pRHS);
+	}
+
+	BasicBlock* merge = BasicBlock::Create(*this, "", rhsEnd->getParent());
+	builder.CreateBr(merge);
+	builder.SetInsertPoint(sc->lhsBlock);
+	if (sc->bAndAlso)
+		builder.CreateCondBr(sc->lhs, sc->rhsBlock, merge);
+	else
+		builder.CreateCondBr(sc->lhs, merge, sc->rhsBlock);
+
+	// the left side alone decided it when we come from there
+	builder.SetInsertPoint(merge);
+	PHINode* phi = builder.CreatePHI(builder.getInt1Ty(), 2);
+	phi->addIncoming(builder.getInt1(!sc->bAndAlso), sc->lhsBlock);
+	phi->addIncoming(pRHS, rhsEnd);
+	m_activeBlock = merge;
+	return phi;
+}
+
+void interpreter::end_of_line()
+{
+	// If a Then If b Then x = 1 closes both
+	if_stmt* pIf = last_if();
+	while (pIf && pIf->is_single_line())
+	{
+		pop_context();
+		pIf->make_end_if();
+		pIf = last_if();
+	}
+}
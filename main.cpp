@@ -1,11 +1,370 @@
 #include "basic.h"
+#include "cache.h"
+#include <llvm/Support/ThreadPool.h>
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <mutex>
+#include <atomic>
+#include <unistd.h>
 
-basic::interpreter* interp = nullptr;
+enum emit_kind
+{
+	EMIT_LL,
+	EMIT_BC,
+	EMIT_OBJ,
+	EMIT_EXE
+};
 
-int main(int argc, char** argv)
+struct options
+{
+	emit_kind nEmit = EMIT_LL;
+	const char* pszCpu = nullptr;
+	bool bRun = false;
+	bool bIncremental = false;
+	bool bVectorize = true;
+	bool bFastMath = false;
+	bool bFold = true;
+	bool bCheckedArith = false;
+	bool bLibrary = false;
+	const char* pszProfileGenerate = nullptr;
+	const char* pszProfileUse = nullptr;
+	std::vector<const char*> libraries;
+	int nTimeReport = 0;  // 1 = text, 2 = json
+	int nStats = 0;
+	int nOptLevel = 0;
+	unsigned nJobs = 1;
+	std::vector<const char*> inputs;
+	const char* pszOutput = nullptr;
+	bool bCache = false;
+	std::string strCacheDir;
+	uint64_t nCacheSize = 512;  // MiB
+};
+
+static void usage(const char* prog)
+{
+	std::cerr << "usage: " << prog << " [-O0|-O1|-O2|-O3] [--run | --incremental]\n"
+		<< "       " << prog << " [-O0|-O1|-O2|-O3] [--run] file.bas [-o out.ll]\n"
+		<< "       " << prog << " [-O0|-O1|-O2|-O3] [-j N] a.bas b.bas ...\n"
+		<< "  -O<n>              optimization level, the default is -O0\n"
+		<< "  --run              JIT compile and execute the session after quit\n"
+		<< "  -i, --incremental  execute every statement as soon as it is complete\n"
+		<< "  -o <file>          output file for batch mode, the default is file.ll\n"
+		<< "  -j <n>             compile the files on n threads, the default is 1\n"
+		<< "  --emit=ll|bc|obj|exe  textual IR (default), bitcode, native object, or executable\n"
+		<< "  -c                 same as --emit=obj\n"
+		<< "  -march=native      tune the native code for this CPU, -mcpu=<name> for others\n"
+		<< "  --no-vectorize     keep the For loops scalar\n"
+		<< "  --fast-math        the vectorized loops may reorder Single/Double sums\n"
+		<< "  --no-fold          no simplification while building the IR\n"
+		<< "  --checked-arith    stop on Integer/Long overflow instead of wrapping\n"
+		<< "  --library          only Subs and Functions, for -l (with --emit=bc)\n"
+		<< "  -l <lib.bc>        link the procedures used from a precompiled library\n"
+		<< "  --profile-generate[=<file.profraw>]  the executable counts its branches\n"
+		<< "  --profile-use=<file.profdata>        optimize with the merged counts\n"
+		<< "  --cache[=<dir>]    reuse the code compiled from the same source (batch mode)\n"
+		<< "  --cache-size=<MiB> the least recently used files go beyond it, 0 is no limit\n"
+		<< "  --trace=<spec>     lexer,parser,codegen,casts or all, with an optional :level\n"
+		<< "  --time-report[=json]  time spent in each compilation phase\n"
+		<< "  --stats[=json]        statement, instruction, cast and lookup counters\n";
+}
+
+// the -j threads report one at a time
+static std::mutex s_reportMutex;
+// --cache, shared by the -j threads
+static std::unique_ptr<basic::compile_cache> s_cache;
+
+static void report(basic::interpreter& bi, const options& opt)
+{
+	std::lock_guard<std::mutex> lock(s_reportMutex);
+	const basic::compile_stats& stats = bi.get_stats();
+	if (opt.nTimeReport == 1)
+		stats.print_time_report(std::cerr);
+	else if (opt.nTimeReport == 2)
+		stats.print_time_report_json(std::cerr);
+	if (opt.nStats == 1)
+		stats.print_stats(std::cerr);
+	else if (opt.nStats == 2)
+		stats.print_stats_json(std::cerr);
+}
+
+static const char* emit_extension(emit_kind nEmit)
+{
+	switch (nEmit)
+	{
+	case EMIT_BC:
+		return ".bc";
+	case EMIT_OBJ:
+		return ".o";
+	case EMIT_EXE:
+		return "";
+	default:
+		return ".ll";
+	}
+}
+
+// the settings and the libraries, the same for every interpreter
+static bool configure(basic::interpreter& bi, const options& opt)
+{
+	bi.set_opt_level(opt.nOptLevel);
+	bi.set_lexer_timing(opt.nTimeReport != 0);
+	bi.set_vectorize(opt.bVectorize);
+	bi.set_fast_math(opt.bFastMath);
+	bi.set_folding(opt.bFold);
+	bi.set_checked_arith(opt.bCheckedArith);
+	bi.set_library(opt.bLibrary);
+	if (opt.pszProfileGenerate)
+		bi.set_profile_generate(opt.pszProfileGenerate);
+	if (opt.pszProfileUse)
+		bi.set_profile_use(opt.pszProfileUse);
+	if (opt.pszCpu)
+		bi.set_cpu(opt.pszCpu);
+	for (auto pszLib: opt.libraries)
+	{
+		if (!bi.load_library(pszLib))
+			return false;
+	}
+	return true;
+}
+
+static bool write_file(const std::string& strPath, llvm::StringRef data)
+{
+	std::ofstream ofs(strPath, std::ios::binary);
+	ofs.write(data.data(), data.size());
+	ofs.close();
+	if (!ofs)
+	{
+		std::cerr << "basic: cannot write " << strPath << "\n";
+		return false;
+	}
+	return true;
+}
+
+static void write_module(basic::interpreter& bi, const std::string& strOutput, bool bFile)
+{
+	std::string buff = "; Output from Basic Interpreter Session";
+	bi.print_module(buff);
+	if (!bFile)
+		std::cout << buff << "\n";
+
+	std::ofstream ofs(strOutput);
+	ofs << buff << "\n";
+	ofs.close();
+}
+
+static void print_run_times(basic::interpreter& bi)
+{
+	std::cerr << "compile: " << bi.get_compile_time() << " ms, "
+		<< "execute: " << bi.get_execute_time() << " ms\n";
+}
+
+static int link_object(llvm::StringRef obj, const options& opt, const std::string& strOutput)
+{
+	std::string strObject = strOutput + ".o";
+	bool bOk = write_file(strObject, obj)
+		&& basic::interpreter::link_executable(strObject.c_str(), strOutput.c_str(), opt.pszProfileGenerate != nullptr);
+	unlink(strObject.c_str());
+	return bOk ? 0 : 1;
+}
+
+// the object goes into the cache too when there is a strKey
+static bool emit_cached_object(basic::interpreter& bi, const std::string& strKey,
+		llvm::SmallVectorImpl<char>& obj)
+{
+	if (!bi.emit_object(obj))
+		return false;
+	if (!strKey.empty())
+		s_cache->store(strKey, ".o", llvm::StringRef(obj.data(), obj.size()));
+	return true;
+}
+
+// strKey is not empty when the results go into the cache
+static int finish(basic::interpreter& bi, const options& opt, const std::string& strOutput, bool bFile,
+		const std::string& strKey = std::string())
+{
+	// this should make correct return void
+	bi.quit();
+	if (!bi.link_libraries())
+		return 1;
+	// the module did not verify, nothing is printed, emitted or run
+	if (!bi.optimize())
+		return 1;
+
+	llvm::SmallVector<char, 0> obj;
+	if (opt.nEmit == EMIT_OBJ || opt.nEmit == EMIT_EXE)
+	{
+		// the same way as a cache hit, from the object in memory
+		if (!emit_cached_object(bi, strKey, obj))
+			return 1;
+		llvm::StringRef data(obj.data(), obj.size());
+		if (opt.nEmit == EMIT_OBJ)
+			return write_file(strOutput, data) ? 0 : 1;
+		return link_object(data, opt, strOutput);
+	}
+
+	// the .ll is printed from the cached bitcode
+	llvm::SmallVector<char, 0> bc;
+	if (opt.nEmit == EMIT_BC || !strKey.empty())
+		bi.write_bitcode(bc);
+	if (!strKey.empty())
+		s_cache->store(strKey, ".bc", llvm::StringRef(bc.data(), bc.size()));
+	if (opt.nEmit == EMIT_BC)
+	{
+		if (!write_file(strOutput, llvm::StringRef(bc.data(), bc.size())))
+			return 1;
+	}
+	else
+		write_module(bi, strOutput, bFile);
+
+	if (opt.bRun)
+	{
+		// the JIT takes the module, so this must be the last thing we do
+		if (!strKey.empty())
+		{
+			// with the cache, main() runs from the object that was stored
+			if (!emit_cached_object(bi, strKey, obj))
+				return 1;
+			auto buffer = llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(obj.data(), obj.size()));
+			if (bi.run_object(std::move(buffer)) != 0)
+				return 1;
+		}
+		else if (bi.run() != 0)
+			return 1;
+		print_run_times(bi);
+	}
+	return 0;
+}
+
+// a cache hit: nothing is parsed or compiled, false on a miss
+static bool finish_cached(basic::interpreter& bi, const options& opt, const std::string& strKey,
+		const std::string& strOutput, int& result)
+{
+	result = 0;
+	if (opt.nEmit == EMIT_OBJ || opt.nEmit == EMIT_EXE)
+	{
+		auto obj = s_cache->lookup(strKey, ".o");
+		if (!obj)
+			return false;
+		if (opt.nEmit == EMIT_OBJ)
+			result = write_file(strOutput, obj->getBuffer()) ? 0 : 1;
+		else
+			result = link_object(obj->getBuffer(), opt, strOutput);
+		return true;
+	}
+
+	// the IR to print, and the code to run
+	auto bc = s_cache->lookup(strKey, ".bc");
+	if (!bc)
+		return false;
+	std::unique_ptr<llvm::MemoryBuffer> obj;
+	if (opt.bRun && !(obj = s_cache->lookup(strKey, ".o")))
+		return false;
+	if (opt.nEmit == EMIT_BC)
+	{
+		if (!write_file(strOutput, bc->getBuffer()))
+			result = 1;
+	}
+	else if (bi.load_bitcode(bc->getMemBufferRef()))
+		write_module(bi, strOutput, true);
+	else
+		return false;
+	if (opt.bRun)
+	{
+		if (bi.run_object(std::move(obj)) != 0)
+			result = 1;
+		else
+			print_run_times(bi);
+	}
+	return true;
+}
+
+// batch mode, the whole file is parsed at once
+static int compile_file(const options& opt, const char* pszInput)
+{
+	std::string strOutput;
+	if (opt.pszOutput)
+		strOutput = opt.pszOutput;
+	else
+	{
+		strOutput = pszInput;
+		size_t pos = strOutput.rfind(".bas");
+		if (pos != std::string::npos && pos == strOutput.size() - 4)
+			strOutput.erase(pos);
+		strOutput += emit_extension(opt.nEmit);
+		if (strOutput == pszInput)
+			strOutput = "a.out";
+	}
+
+	basic::interpreter bi(pszInput);
+	if (!configure(bi, opt))
+		return 1;
+
+	// the key is the source and the settings above
+	std::string strKey;
+	if (s_cache)
+	{
+		auto source = llvm::MemoryBuffer::getFile(pszInput);
+		if (source)
+		{
+			strKey = basic::compile_cache::make_key((*source)->getBuffer(), bi.get_cache_config());
+			int result = 0;
+			if (finish_cached(bi, opt, strKey, strOutput, result))
+			{
+				s_cache->count_hit();
+				report(bi, opt);
+				return result;
+			}
+			s_cache->count_miss();
+		}
+	}
+
+	if (bi.eval_file(pszInput) != 0)
+	{
+		std::lock_guard<std::mutex> lock(s_reportMutex);
+		std::cerr << pszInput << ": " << bi.get_error_count() << " error(s)\n";
+		return 1;
+	}
+	int result = finish(bi, opt, strOutput, true, strKey);
+	report(bi, opt);
+	return result;
+}
+
+// every file gets its own interpreter, which has its own LLVMContext,
+// so nothing is shared between the threads but the target registry
+static int compile_files(const options& opt)
+{
+	if (opt.nJobs <= 1 || opt.inputs.size() == 1)
+	{
+		int result = 0;
+		for (auto pszInput: opt.inputs)
+		{
+			if (compile_file(opt, pszInput) != 0)
+				result = 1;
+		}
+		return result;
+	}
+
+	std::atomic<int> failed(0);
+	llvm::ThreadPool pool(std::min<size_t>(opt.nJobs, opt.inputs.size()));
+	for (auto pszInput: opt.inputs)
+	{
+		pool.async([&opt, &failed, pszInput]() {
+			if (compile_file(opt, pszInput) != 0)
+				failed++;
+		});
+	}
+	pool.wait();
+	return failed ? 1 : 0;
+}
+
+static int run_session(const options& opt)
 {
 	basic::interpreter bi("session");
+	if (!configure(bi, opt))
+		return 1;
+	if (opt.bIncremental)
+		bi.set_incremental(true);
 	bi.print_version(std::cout);
 	std::cout << "\nbasic:$ ";
 
@@ -22,27 +381,169 @@ int main(int argc, char** argv)
 			// bail
 			break;
 		}
-		if (bi.eval(buff) >= 0)
+		if (bi.eval(buff) == 0)
 		{
 			// record the statement into a file
 			bas_mod << buff << "\n";
+			if (opt.bIncremental)
+				bi.run_statement();
+		}
+		else if (opt.bIncremental)
+		{
+			// whatever was emitted before the error is never run
+			bi.discard_statement();
 		}
 		std::cout << "basic:$ ";
 	}
 
 	bas_mod.close();
 
-	// this should make correct return void
-	bi.quit();
+	// everything has already been executed,
+	// and the modules are owned by the JIT
+	int result = 0;
+	if (!opt.bIncremental)
+		result = finish(bi, opt, std::string("session") + emit_extension(opt.nEmit), false);
+	report(bi, opt);
+	return result;
+}
 
-	buff = "; Output from Basic Interpreter Session";
-	bi.print_module(buff);
-	std::cout << buff << "\n";
+int main(int argc, char** argv)
+{
+	options opt;
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '3' && !argv[i][3])
+			opt.nOptLevel = argv[i][2] - '0';
+		else if (!strcmp(argv[i], "--run"))
+			opt.bRun = true;
+		else if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--incremental"))
+			opt.bIncremental = true;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			opt.pszOutput = argv[++i];
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			opt.nJobs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--emit=obj"))
+			opt.nEmit = EMIT_OBJ;
+		else if (!strcmp(argv[i], "--emit=exe"))
+			opt.nEmit = EMIT_EXE;
+		else if (!strcmp(argv[i], "--emit=ll"))
+			opt.nEmit = EMIT_LL;
+		else if (!strcmp(argv[i], "--emit=bc"))
+			opt.nEmit = EMIT_BC;
+		else if (!strcmp(argv[i], "--library"))
+			opt.bLibrary = true;
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			opt.libraries.push_back(argv[++i]);
+		else if (!strcmp(argv[i], "-march=native"))
+			opt.pszCpu = "native";
+		else if (!strncmp(argv[i], "-mcpu=", 6))
+			opt.pszCpu = argv[i] + 6;
+		else if (!strcmp(argv[i], "--no-vectorize"))
+			opt.bVectorize = false;
+		else if (!strcmp(argv[i], "--fast-math"))
+			opt.bFastMath = true;
+		else if (!strcmp(argv[i], "--no-fold"))
+			opt.bFold = false;
+		else if (!strcmp(argv[i], "--checked-arith"))
+			opt.bCheckedArith = true;
+		else if (!strcmp(argv[i], "--time-report"))
+			opt.nTimeReport = 1;
+		else if (!strcmp(argv[i], "--time-report=json"))
+			opt.nTimeReport = 2;
+		else if (!strcmp(argv[i], "--stats"))
+			opt.nStats = 1;
+		else if (!strcmp(argv[i], "--stats=json"))
+			opt.nStats = 2;
+		else if (!strcmp(argv[i], "--profile-generate"))
+			opt.pszProfileGenerate = "default.profraw";
+		else if (!strncmp(argv[i], "--profile-generate=", 19) && argv[i][19])
+			opt.pszProfileGenerate = argv[i] + 19;
+		else if (!strncmp(argv[i], "--profile-use=", 14) && argv[i][14])
+			opt.pszProfileUse = argv[i] + 14;
+		else if (!strcmp(argv[i], "--cache"))
+			opt.bCache = true;
+		else if (!strncmp(argv[i], "--cache=", 8) && argv[i][8])
+		{
+			opt.bCache = true;
+			opt.strCacheDir = argv[i] + 8;
+		}
+		else if (!strncmp(argv[i], "--cache-size=", 13) && isdigit(argv[i][13]))
+			opt.nCacheSize = strtoull(argv[i] + 13, nullptr, 10);
+		else if (!strncmp(argv[i], "--trace=", 8))
+		{
+#ifndef BASIC_ENABLE_TRACE
+			std::cerr << "basic: tracing is not compiled in, rebuild with make TRACE=1\n";
+#endif
+			if (!basic::trace::configure(argv[i] + 8))
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (argv[i][0] != '-')
+			opt.inputs.push_back(argv[i]);
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
 
-	std::ofstream ofs("session.ll");
-	ofs << buff << "\n";
-	ofs.close();
+	// the statements of a session are linked as they come, and a
+	// library has no main() to run
+	if ((opt.bIncremental && !opt.libraries.empty()) || (opt.bLibrary && (opt.bRun || opt.bIncremental)))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	// an object or an executable is only written, --run would be ignored
+	if (opt.bRun && (opt.nEmit == EMIT_OBJ || opt.nEmit == EMIT_EXE))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	// the PGO passes are part of the optimization pipeline, and the
+	// counters need the profile runtime of a native executable
+	if ((opt.pszProfileGenerate || opt.pszProfileUse) && opt.nOptLevel == 0)
+	{
+		std::cerr << "basic: profile-guided optimization needs -O1 or higher\n";
+		return 1;
+	}
+	if (opt.pszProfileGenerate && (opt.pszProfileUse || opt.bRun || opt.bIncremental || opt.inputs.empty()
+			|| (opt.nEmit != EMIT_OBJ && opt.nEmit != EMIT_EXE)))
+	{
+		usage(argv[0]);
+		return 1;
+	}
 
-	return 0;
-}
+	int result = 0;
+	if (!opt.inputs.empty())
+	{
+		// one output file, or one program to run, is for one input
+		if (opt.bIncremental || (opt.inputs.size() > 1 && (opt.pszOutput || opt.bRun)))
+		{
+			usage(argv[0]);
+			return 1;
+		}
+		if (opt.bCache)
+		{
+			if (opt.strCacheDir.empty())
+				opt.strCacheDir = basic::compile_cache::default_dir();
+			s_cache = std::make_unique<basic::compile_cache>(opt.strCacheDir, opt.nCacheSize << 20);
+		}
+		result = compile_files(opt);
+		if (s_cache && opt.nStats == 1)
+			s_cache->print_stats(std::cerr);
+		else if (s_cache && opt.nStats == 2)
+			s_cache->print_stats_json(std::cerr);
+	}
+	else
+		result = run_session(opt);
 
+	if (basic::trace::get_count() > 0)
+	{
+		std::cerr << "trace: " << basic::trace::get_count() << " records, "
+			<< basic::trace::get_overhead() << " ms spent tracing\n";
+	}
+	return result;
+}
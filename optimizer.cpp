@@ -0,0 +1,137 @@
+#include "basic.h"
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Target/TargetMachine.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Optimization pipeline, built on the new PassManager.
+//
+// The IRBuilder output is pretty naive: every variable is an alloca,
+// and every use of it is a load, so even -O1 makes a big difference.
+// The default pipelines give us SROA/mem2reg, instcombine, GVN, LICM,
+// loop rotation, indvars, unrolling and the loop vectorizer.
+//
+// Profile-guided optimization goes through the same pipeline, LLVM's
+// PGO passes run first: --profile-generate counts the edges of the CFG
+// (the For and If branches, the calls), and the profile runtime writes
+// the counters to a .profraw file at exit. llvm-profdata merges it into
+// a .profdata file, which --profile-use turns into !prof branch weights
+// and function entry counts, before anything is inlined or unrolled.
+/////////////////////////////////////////////////////////////////////////
+
+MDNode* interpreter::make_loop_metadata(bool bForce)
+{
+	// A For loop over array elements without Exit For has no side exits,
+	// and the arrays never overlap, so ask for vectorization rather than
+	// leaving it to the cost model. That also allows the floating-point
+	// reductions to be reordered, for_stmt only asks with --fast-math then.
+	// Forcing it on a Do loop would only get us a warning when it fails.
+	SmallVector<Metadata*, 3> ops;
+	ops.push_back(nullptr);   // the loop id refers to itself
+	Type* i32 = Type::getInt32Ty(*this);
+	if (m_vectorize && bForce)
+	{
+		Metadata* enable[] = {
+			MDString::get(*this, "llvm.loop.vectorize.enable"),
+			ConstantAsMetadata::get(ConstantInt::getTrue(*this))
+		};
+		ops.push_back(MDNode::get(*this, enable));
+	}
+	else if (!m_vectorize)
+	{
+		Metadata* width[] = {
+			MDString::get(*this, "llvm.loop.vectorize.width"),
+			ConstantAsMetadata::get(ConstantInt::get(i32, 1))
+		};
+		Metadata* interleave[] = {
+			MDString::get(*this, "llvm.loop.interleave.count"),
+			ConstantAsMetadata::get(ConstantInt::get(i32, 1))
+		};
+		ops.push_back(MDNode::get(*this, width));
+		ops.push_back(MDNode::get(*this, interleave));
+	}
+	MDNode* loopId = MDNode::getDistinct(*this, ops);
+	loopId->replaceOperandWith(0, loopId);
+	return loopId;
+}
+
+void interpreter::set_profile_generate(const std::string& strPath)
+{
+	m_profileGenerate = strPath;
+}
+
+void interpreter::set_profile_use(const std::string& strPath)
+{
+	m_profileUse = strPath;
+}
+
+void interpreter::set_opt_level(int nLevel)
+{
+	if (nLevel < 0)
+		nLevel = 0;
+	else if (nLevel > 3)
+		nLevel = 3;
+	m_optLevel = nLevel;
+}
+
+bool interpreter::optimize()
+{
+	if (!module)
+		return false;
+
+	// don't feed broken IR into the optimizer,
+	// the passes assume the module is valid.
+	{
+		phase_timer timer(m_stats, compile_stats::PHASE_VERIFY);
+		if (verifyModule(*module, &errs()))
+		{
+			std::cerr << "basic: the module is not valid, it is not emitted or run.\n";
+			return false;
+		}
+	}
+
+	if (m_optLevel == 0)
+		return true;
+
+	phase_timer timer(m_stats, compile_stats::PHASE_OPTIMIZE);
+
+	TargetMachine* tm = get_target_machine();
+	if (tm)
+	{
+		module->setTargetTriple(tm->getTargetTriple().str());
+		module->setDataLayout(tm->createDataLayout());
+	}
+
+	Optional<PGOOptions> pgo;
+	if (!m_profileGenerate.empty())
+		pgo = PGOOptions(m_profileGenerate, "", "", "", true);
+	else if (!m_profileUse.empty())
+		pgo = PGOOptions("", m_profileUse, "", "", false);
+	PassBuilder pb(tm, pgo);
+
+	LoopAnalysisManager lam;
+	FunctionAnalysisManager fam;
+	CGSCCAnalysisManager cgam;
+	ModuleAnalysisManager mam;
+
+	fam.registerPass([&] { return pb.buildDefaultAAPipeline(); });
+	pb.registerModuleAnalyses(mam);
+	pb.registerCGSCCAnalyses(cgam);
+	pb.registerFunctionAnalyses(fam);
+	pb.registerLoopAnalyses(lam);
+	pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+	PassBuilder::OptimizationLevel level = PassBuilder::O2;
+	if (m_optLevel == 1)
+		level = PassBuilder::O1;
+	else if (m_optLevel == 3)
+		level = PassBuilder::O3;
+
+	ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(level);
+	mpm.run(*module, mam);
+	return true;
+}
@@ -1,27 +1,50 @@
 %{
 #include "basic.h"
-extern int yylex(basic_parser_types*);
+extern int basic_lex(basic_parser_types*, void* scanner);
+static int yylex(basic_parser_types* lval, basic::interpreter* interp);
 extern void yyerror(basic::interpreter* interp, const char* msg);
+static basic::sub_stmt* begin_procedure(basic::interpreter* interp, int tok, const char* name,
+		const basic::param_list* params, int nRetType);
+static bool end_procedure(basic::interpreter* interp, int tok, bool bExit);
 %}
 
 %output "parser.cpp"
 %define api.value.type {basic_parser_types}
 %define api.pure full
 %parse-param {basic::interpreter* interp}
+%lex-param {basic::interpreter* interp}
 
 %token <llvmConstant> BYTE BOOLEAN INTEGER LONG SINGLE DOUBLE STRING OBJECT
-%token <typeID>       DIM FUNCTION SUB END AS TYPEID KEYWORD IF ELSE ELSEIF ENDIF THEN FOR EACH NEXT TO STEP
+%token <typeID>       DIM FUNCTION SUB END AS TYPEID KEYWORD IF ELSE ELSEIF ENDIF THEN FOR EACH NEXT TO STEP REDIM EXIT PRINT
+%token <typeID>       AND OR XOR NOT ANDALSO ORELSE SELECT CASE
+%token <typeID>       DO LOOP WHILE UNTIL CONTINUE
+%token                LE GE NE
 %token <llvmValue>    VAR
 %token <identifier>   ID FUNCTION_NAME CURRENT_FUNCTION_NAME
 %type <llvmValue>     expr function_call
 %type <llvmConstant> constant
 %type <dim> dim_stmt
-%type <ifStmt> if_stmt
-%type <llvmValueList> argument_list
+%type <ifStmt> if_stmt if_head
+%type <llvmValueList> argument_list expr_list
 %type <forStmt> for_stmt
+%type <subStmt> sub_stmt
+%type <selectStmt> select_stmt
+%type <doStmt> do_stmt
+%type <typeID> do_test
+%type <caseList> case_list
+%type <paramList> param_list
+%type <typeID> print_list print_separator
 
 
-%left '+' '-' '*' '/'
+%left ORELSE
+%left ANDALSO
+%left OR XOR
+%left AND
+%right NOT
+%nonassoc '=' '<' '>' LE GE NE
+%left '&'
+%left '+' '-'
+%left '*' '/'
 %right '^'
 
 
@@ -29,37 +52,143 @@ extern void yyerror(basic::interpreter* interp, const char* msg);
 
 input:
 	%empty /* no inputs */
-|   input line
+|   input line {
+    // the statement nodes are released as soon as
+	// there is no open block left
+    interp->end_of_statement();
+}
 ;
 
 line:
-	'\n'
+	'\n' {
+    // a single-line If ends here
+    interp->end_of_line();
+}
+|   error '\n' {
+    // skip the rest of the line, so a batch compile
+	// can report more than the first error
+    interp->add_error();
+	yyerrok;
+}
 |   expr {
-    std::string buff("expr: ");
-	llvm::raw_string_ostream rso(buff);
-	$1->print(rso);
-	rso << "\n";
-	std::cerr << buff << "\n";
+    interp->get_stats().count_statement();
+    BASIC_TRACE(basic::TRACE_PARSER, 1, {
+	    std::string buff("expr: ");
+		llvm::raw_string_ostream rso(buff);
+		$1->print(rso);
+		basic::trace::write(rso.str());
+	});
+}
+|   ID '=' expr {
+    interp->get_stats().count_statement();
+	// at the start of a statement, = assigns,
+	// everywhere else it compares
+	llvm::Value* pVar = interp->find_variable($1);
+	if (!pVar || interp->is_array(pVar))
+	{
+	    std::cerr << "error: " << $1 << " is not a variable\n";
+		YYERROR;
+	}
+	BASIC_TRACE(basic::TRACE_CODEGEN, 2, basic::trace::write("assigning variable"));
+	interp->assign_variable(pVar, $3);
+}
+|   ID '(' expr_list ')' '=' expr {
+    interp->get_stats().count_statement();
+	llvm::Value* pElem = nullptr;
+	if ($3->size() == 1)
+	    pElem = interp->make_element_ref($1, $3->front());
+	if (!pElem)
+	{
+	    std::cerr << "error: " << $1 << " is not an array\n";
+		YYERROR;
+	}
+	interp->assign_variable(pElem, $6);
 }
 |   dim_stmt {
-    std::cerr << "DIM" << "\n";
-    $1->print_debug();
+    interp->get_stats().count_statement();
+    BASIC_TRACE(basic::TRACE_PARSER, 1, $1->print_debug());
 }
 |   if_stmt {
-    std::string buff("IF ");
-	$1->get_debug_string(buff);
-	std::cerr << buff << "\n";
+    interp->get_stats().count_statement();
+    BASIC_TRACE(basic::TRACE_PARSER, 1, {
+	    std::string buff("IF ");
+		$1->get_debug_string(buff);
+		basic::trace::write(buff);
+	});
 }
 |   for_stmt {
-    std::string buff("FOR ");
-	$1->get_debug_string(buff);
-	std::cerr << buff << "\n";
+    interp->get_stats().count_statement();
+    // this one prints the whole start block, only on level 2
+    BASIC_TRACE(basic::TRACE_PARSER, 2, {
+	    std::string buff("FOR ");
+		$1->get_debug_string(buff);
+		basic::trace::write(buff);
+	});
+}
+|   sub_stmt {
+    interp->get_stats().count_statement();
+}
+|   do_stmt {
+    interp->get_stats().count_statement();
+}
+|   EXIT FOR {
+    interp->get_stats().count_statement();
+	if (!interp->make_loop_jump(FOR, true))
+	{
+	    yyerror(interp, "Exit For outside of a For loop");
+		YYERROR;
+	}
+}
+|   EXIT DO {
+    interp->get_stats().count_statement();
+	if (!interp->make_loop_jump(DO, true))
+	{
+	    yyerror(interp, "Exit Do outside of a Do loop");
+		YYERROR;
+	}
+}
+|   CONTINUE FOR {
+    interp->get_stats().count_statement();
+	if (!interp->make_loop_jump(FOR, false))
+	{
+	    yyerror(interp, "Continue For outside of a For loop");
+		YYERROR;
+	}
+}
+|   CONTINUE DO {
+    interp->get_stats().count_statement();
+	if (!interp->make_loop_jump(DO, false))
+	{
+	    yyerror(interp, "Continue Do outside of a Do loop");
+		YYERROR;
+	}
+}
+|   select_stmt {
+    interp->get_stats().count_statement();
+}
+|   PRINT {
+    interp->get_stats().count_statement();
+	interp->print_char('\n');
+}
+|   PRINT print_list {
+    interp->get_stats().count_statement();
+	// a trailing separator keeps the line open
+	if (!$2)
+	    interp->print_char('\n');
+}
+|   REDIM ID '(' expr ')' {
+    interp->get_stats().count_statement();
+	if (!interp->redim_array($2, $4))
+	    YYERROR;
 }
 |   function_call {
-    std::string buff("CALL: ");
-	llvm::raw_string_ostream rso(buff);
-	$1->print(rso);
-	std::cerr << buff << "\n";
+    interp->get_stats().count_statement();
+    BASIC_TRACE(basic::TRACE_PARSER, 1, {
+	    std::string buff("CALL: ");
+		llvm::raw_string_ostream rso(buff);
+		$1->print(rso);
+		basic::trace::write(rso.str());
+	});
 }
 ;
 
@@ -71,16 +200,41 @@ expr:
 	llvm::Value* pVar = interp->find_variable($1);
 	if (!pVar)
 	{
-	    llvm::Constant* pfn = interp->find_function($1);
-		if (!pfn)
+	    // a Sub or Function without arguments
+	    if (!interp->find_function($1))
 		{
 		    std::cerr << "Unrecognized identifier: " << $1 << "\n";
 			YYERROR;
 		}
-		pVar = static_cast<llvm::Value*>(pfn);
+		pVar = interp->make_call($1, basic::value_list());
+		if (!pVar)
+		    YYERROR;
+	}
+	else if (interp->is_array(pVar))
+	{
+	    std::cerr << "Array " << $1 << " needs an index\n";
+		YYERROR;
 	}
 	$$ = pVar;
 }
+|   ID '(' expr_list ')' {
+    // an array element, it can be assigned like a variable,
+	// or a call
+	llvm::Value* pResult = nullptr;
+	if ($3->size() == 1)
+	    pResult = interp->make_element_ref($1, $3->front());
+	if (!pResult)
+	    pResult = interp->make_call($1, *$3);
+	if (!pResult)
+	    YYERROR;
+	$$ = pResult;
+}
+|   ID '(' ')' {
+    $$ = interp->make_call($1, basic::value_list());
+	if (!$$)
+	    YYERROR;
+}
+|   expr '&' expr { $$ = interp->make_concat($1, $3); }
 |   expr '+' expr { $$ = interp->make_add($1, $3); }
 |   expr '-' expr { $$ = interp->make_subtract($1, $3); }
 |   expr '*' expr { $$ = interp->make_mult($1, $3); }
@@ -88,133 +242,165 @@ expr:
 |   expr '^' expr { $$ = interp->make_pow($1, $3); }
 |   expr '<' expr { $$ = interp->make_compare_less_than($1, $3); }
 |   expr '>' expr { $$ = interp->make_compare_greater_than($1, $3); }
+|   expr LE expr { $$ = interp->make_comparison($1, $3, llvm::CmpInst::ICMP_SLE); }
+|   expr GE expr { $$ = interp->make_comparison($1, $3, llvm::CmpInst::ICMP_SGE); }
+|   expr NE expr { $$ = interp->make_comparison($1, $3, llvm::CmpInst::ICMP_NE); }
+|   expr '=' expr { $$ = interp->make_equal_comparison($1, $3); }
+|   expr AND expr { $$ = interp->make_logical(llvm::Instruction::And, $1, $3); }
+|   expr OR expr { $$ = interp->make_logical(llvm::Instruction::Or, $1, $3); }
+|   expr XOR expr { $$ = interp->make_logical(llvm::Instruction::Xor, $1, $3); }
+|   NOT expr { $$ = interp->make_not($2); }
+|   expr ANDALSO {
+    // the right side is only evaluated when the left one is true
+    $<shortCircuit>$ = interp->begin_short_circuit($1, true);
+} expr {
+    $$ = interp->end_short_circuit($<shortCircuit>3, $4);
+}
+|   expr ORELSE {
+    $<shortCircuit>$ = interp->begin_short_circuit($1, false);
+} expr {
+    $$ = interp->end_short_circuit($<shortCircuit>3, $4);
+}
 |   '(' expr ')' { $$ = $2; }
-|   expr '=' expr {
-    if (llvm::AllocaInst::classof($1))
-	{
-	    // we only allow assignment to a variable,
-		// indicated by the given Value is derived from AllocaInst,
-		// otherwise, it would be a constant
-		// or FUNCTION
-		std::cerr << "assigning variable\n";
-		$$ = interp->assign_variable($1, $3);
-	}
-	else if (llvm::Function::classof($1))
-	{
-	    $$ = interp->make_return_value(static_cast<llvm::Constant*>($1), $3);
-	}
-	else
-	{
-	    // treat this action as comparison
-		$$ = interp->make_equal_comparison($1, $3);
-	}
+;
+
+print_list:
+	expr {
+	if (!interp->print_value($1))
+	    YYERROR;
+	$$ = 0;
+}
+|   print_list print_separator expr {
+	if (!interp->print_value($3))
+	    YYERROR;
+	$$ = 0;
+}
+|   print_list print_separator { $$ = $2; }
+;
+
+print_separator:
+	';' { $$ = ';'; }
+|   ',' {
+    interp->print_char('\t');
+	$$ = ',';
 }
 ;
 
 dim_stmt:
 	DIM ID AS TYPEID {
-	basic::dim_stmt* pDim = new basic::dim_stmt();
+	basic::dim_stmt* pDim = interp->create<basic::dim_stmt>(interp);
 	pDim->add_variable($4, $2);
 	$$ = pDim;
 }
+|   DIM ID '(' expr ')' AS TYPEID {
+	basic::dim_stmt* pDim = interp->create<basic::dim_stmt>(interp);
+	if (!pDim->add_array($7, $2, $4))
+	    YYERROR;
+	$$ = pDim;
+}
+|   DIM ID '(' ')' AS TYPEID {
+    // the storage comes later, with ReDim
+	basic::dim_stmt* pDim = interp->create<basic::dim_stmt>(interp);
+	pDim->add_array($6, $2, nullptr);
+	$$ = pDim;
+}
 |   dim_stmt ',' ID AS TYPEID {
     $1->add_variable($5, $3);
 	$$ = $1;
 }
+|   dim_stmt ',' ID '(' expr ')' AS TYPEID {
+    if (!$1->add_array($8, $3, $5))
+	    YYERROR;
+	$$ = $1;
+}
+|   dim_stmt ',' ID '(' ')' AS TYPEID {
+    $1->add_array($7, $3, nullptr);
+	$$ = $1;
+}
 ;
 
 constant:
 	BOOLEAN { $$ = $1; }
 |   LONG { $$ = $1; }
 |   DOUBLE { $$ = $1; }
-|   STRING {
-    // All Strings must be put in Module level address space
-	// and should be marked as constant.
-	llvm::GlobalVariable *gv = new llvm::GlobalVariable(*(interp->get_module().get()),
-	    $1->getType(),
-		true,
-		llvm::GlobalVariable::InternalLinkage,
-		$1);
-	llvm::IRBuilder<> builder(interp->get_current_block());
-	llvm::Value* idx[] = { builder.getInt32(0), builder.getInt32(0) };
-	llvm::Value* pResult = builder.CreateInBoundsGEP(gv, llvm::ArrayRef<llvm::Value*>(idx));
-	$$ = static_cast<llvm::Constant*>(pResult);
-}
+|   STRING { $$ = $1; }
 ;
 
-if_stmt:
-	IF ID '=' expr THEN {
-	llvm::Value* pVar = interp->find_variable($2);
-	if (!pVar)
-	{
-	    yyerror(interp, "Unrecognized identifier, expecting variable name");
-		YYERROR;
-	}
-	llvm::Value* cond = interp->make_equal_comparison(pVar, $4);
-	basic::if_stmt* pObj = new basic::if_stmt(interp->get_current_block(), cond);
+if_head:
+	IF expr THEN {
 	// The interpreter has to define a way to hang this data until we have END IF
 	// because the ELSEIF and ELSE will use it, and END IF will have to pop out
 	// the context, so the control will be returned to the current Function's
 	// previous context (if any), or the function itself.
-	$$ = pObj;
+	$$ = interp->create<basic::if_stmt>(interp, interp->get_current_block(), $2);
 }
-|   ELSEIF ID '=' expr THEN {
-	llvm::Value* pVar = interp->find_variable($2);
-	if (!pVar)
-	{
-	    yyerror(interp, "Unrecognized identifier, expecting variable name");
-		YYERROR;
-	}
-	llvm::Value* cond = interp->make_equal_comparison(pVar, $4);
-	// it must be there
-	basic::if_stmt* prev_if = static_cast<basic::if_stmt*>(interp->pop_context());
-	basic::if_stmt* pObj = new basic::if_stmt(prev_if, ELSEIF, "ElseIf");
-	// this new ElseIf must be pushed as the new context
-	// and the following call will do that, after creating the branch
-	llvm::Value* pResult = pObj->set_branch(cond);
-	$$ = pObj;
-	std::string buff("ElseIf: ");
-	llvm::raw_string_ostream rso(buff);
-	pResult->print(rso);
-	std::cerr << buff << "\n";
-}
-|  IF expr THEN {
-   // We will never know unless we try, this is the most conflicting RULE,
-   // as the expr also define ID as standalone entity, then define expr = expr
-   // the if_stmt MUST check if the condition given returning something
-   // other than a boolean value, and if it is, then it will have
-   // to be converted.
-   basic::if_stmt* pVal = new basic::if_stmt(interp->get_current_block(), $2);
-   $$ = pVal;
-}
-|  ELSEIF expr THEN {
+;
+
+if_stmt:
+	if_head '\n' {
+	$$ = $1;
+}
+|   if_head {
+    // something follows Then on the same line,
+	// the end of the line is the End If
+	$1->set_single_line();
+	$$ = $1;
+}
+|  else_if expr THEN {
    basic::if_stmt* prev_if = static_cast<basic::if_stmt*>(interp->pop_context());
-   basic::if_stmt* pObj = new basic::if_stmt(prev_if, ELSEIF, "ElseIf");
+   basic::if_stmt* pObj = interp->create<basic::if_stmt>(prev_if, ELSEIF, "ElseIf");
    pObj->set_branch($2);
    $$ = pObj;
 }
 |  ELSE {
    // Else must incorporate and implement the previous if's false block
    // and does not have any condition.
-   basic::if_stmt* prev_if = static_cast<basic::if_stmt*>(interp->pop_context());
-   basic::if_stmt* pElse = new basic::if_stmt(prev_if, ELSE, "Else");
+   basic::if_stmt* prev_if = interp->last_if();
+   if (!prev_if || prev_if->type() == ELSE)
+   {
+       yyerror(interp, "Else without If");
+	   YYERROR;
+   }
+   interp->pop_context();
+   prev_if->begin_next_arm();
+   basic::if_stmt* pElse = interp->create<basic::if_stmt>(prev_if, ELSE, "Else");
    // we will define set_branch with empty argument
    pElse->set_branch();
    $$ = pElse;
 }
 |  END IF {
-   basic::if_stmt* prev_if = static_cast<basic::if_stmt*>(interp->pop_context());
-   // we jump to prev_if::false/exitBlock
-   // and signal the interpreter to set the insert point to it's exit block
+   basic::if_stmt* prev_if = interp->last_if();
+   if (!prev_if)
+   {
+       yyerror(interp, "End If without If");
+	   YYERROR;
+   }
+   interp->pop_context();
+   // every arm jumps to the exit block,
+   // and the interpreter carries on from there.
    // the whole if_stmt context was already popped out above.
    prev_if->make_end_if();
    $$ = prev_if;
 }
 ;
 
+else_if:
+	ELSEIF {
+	basic::if_stmt* prev_if = interp->last_if();
+	if (!prev_if || prev_if->type() == ELSE)
+	{
+	    yyerror(interp, "ElseIf without If");
+		YYERROR;
+	}
+	// the previous arm is done, the next condition
+	// is evaluated in its false block
+	prev_if->begin_next_arm();
+}
+;
+
 argument_list:
 	constant {
-	std::vector<llvm::Value*>* pObj = new std::vector<llvm::Value*>();
+	basic::value_list* pObj = interp->create<basic::value_list>();
 	pObj->push_back($1);
 	$$ = pObj;
 }
@@ -228,7 +414,7 @@ argument_list:
 		yyerror(interp, strError.c_str());
 		YYERROR;
 	}
-	std::vector<llvm::Value*>* pObj = new std::vector<llvm::Value*>();
+	basic::value_list* pObj = interp->create<basic::value_list>();
 	pObj->push_back(pVar);
 	$$ = pObj;
 }
@@ -239,26 +425,146 @@ argument_list:
 }
 ;
 
+expr_list:
+	expr {
+	basic::value_list* pObj = interp->create<basic::value_list>();
+	pObj->push_back($1);
+	$$ = pObj;
+}
+|   expr_list ',' expr {
+    $1->push_back($3);
+	$$ = $1;
+}
+;
+
 function_call:
 	ID argument_list {
-	llvm::Constant* pfn = interp->find_function($1);
-	if (!pfn)
+	llvm::Value* pResult = interp->make_call($1, *$2);
+	if (!pResult)
+	    YYERROR;
+	$$ = pResult;
+}
+;
+
+sub_stmt:
+	SUB ID '(' ')' {
+	$$ = begin_procedure(interp, SUB, $2, nullptr, 0);
+	if (!$$)
+	    YYERROR;
+}
+|   SUB ID '(' param_list ')' {
+	$$ = begin_procedure(interp, SUB, $2, $4, 0);
+	if (!$$)
+	    YYERROR;
+}
+|   FUNCTION ID '(' ')' AS TYPEID {
+	$$ = begin_procedure(interp, FUNCTION, $2, nullptr, $6);
+	if (!$$)
+	    YYERROR;
+}
+|   FUNCTION ID '(' param_list ')' AS TYPEID {
+	$$ = begin_procedure(interp, FUNCTION, $2, $4, $7);
+	if (!$$)
+	    YYERROR;
+}
+|   EXIT SUB {
+    if (!end_procedure(interp, SUB, true))
+	    YYERROR;
+	$$ = interp->find_last_sub();
+}
+|   EXIT FUNCTION {
+    if (!end_procedure(interp, FUNCTION, true))
+	    YYERROR;
+	$$ = interp->find_last_sub();
+}
+|   END SUB {
+    $$ = interp->find_last_sub();
+    if (!end_procedure(interp, SUB, false))
+	    YYERROR;
+}
+|   END FUNCTION {
+    $$ = interp->find_last_sub();
+    if (!end_procedure(interp, FUNCTION, false))
+	    YYERROR;
+}
+;
+
+select_stmt:
+	SELECT CASE expr {
+	$$ = interp->create<basic::select_stmt>(interp, interp->get_current_block(), $3);
+}
+|   CASE {
+    basic::select_stmt* pSelect = interp->last_select();
+	if (!pSelect)
 	{
-	    std::string strErr("No such Function/Sub: ");
-		strErr += $1;
-		yyerror(interp, strErr.c_str());
+	    yyerror(interp, "Case without Select Case");
 		YYERROR;
 	}
-	llvm::IRBuilder<> builder(interp->get_current_block());
-	llvm::Value* pResult = builder.CreateCall(pfn, llvm::ArrayRef<llvm::Value*>(*$2));
-	$$ = pResult;
+	// the values are evaluated in the test block of the arm
+	if (!pSelect->begin_case())
+	{
+	    yyerror(interp, "Case after Case Else");
+		YYERROR;
+	}
+} case_list {
+    $$ = interp->last_select();
+	$$->set_case(*$3);
+}
+|   CASE ELSE {
+    $$ = interp->last_select();
+	if (!$$ || !$$->set_case_else())
+	{
+	    yyerror(interp, "Case Else without Select Case");
+		YYERROR;
+	}
+}
+|   END SELECT {
+    $$ = interp->last_select();
+	if (!$$)
+	{
+	    yyerror(interp, "End Select without Select Case");
+		YYERROR;
+	}
+	interp->pop_context();
+	$$->make_end_select();
+}
+;
+
+case_list:
+	expr {
+	basic::case_list* pObj = interp->create<basic::case_list>();
+	pObj->push_back(std::make_pair($1, nullptr));
+	$$ = pObj;
+}
+|   expr TO expr {
+	basic::case_list* pObj = interp->create<basic::case_list>();
+	pObj->push_back(std::make_pair($1, $3));
+	$$ = pObj;
+}
+|   case_list ',' expr {
+    $1->push_back(std::make_pair($3, nullptr));
+	$$ = $1;
+}
+|   case_list ',' expr TO expr {
+    $1->push_back(std::make_pair($3, $5));
+	$$ = $1;
+}
+;
+
+param_list:
+	ID AS TYPEID {
+	basic::param_list* pObj = interp->create<basic::param_list>();
+	pObj->push_back(std::make_pair($1, $3));
+	$$ = pObj;
 }
-|   ID '(' argument_list ')' {
+|   param_list ',' ID AS TYPEID {
+    $1->push_back(std::make_pair($3, $5));
+	$$ = $1;
 }
 ;
 
 for_stmt:
-	FOR ID '=' constant TO constant {
+	FOR ID '=' expr TO expr {
 	llvm::Value* pVar = interp->find_variable($2);
 	if (!pVar)
 	{
@@ -267,12 +573,12 @@ for_stmt:
 		yyerror(interp, buff.c_str());
 		YYERROR;
 	}
-	basic::for_stmt* pObj = new basic::for_stmt(interp->get_current_block(), pVar);
+	basic::for_stmt* pObj = interp->create<basic::for_stmt>(interp, interp->get_current_block(), pVar);
 	pObj->set_condition($4, $6);
 	$$ = pObj;
 }
-|   FOR ID '=' constant TO constant STEP constant {
-    // the only different is the STEP value
+|   FOR ID '=' expr TO expr STEP expr {
+    // the only different is the STEP value, it may be negative
 	llvm::Value* pVar = interp->find_variable($2);
 	if (!pVar)
 	{
@@ -281,7 +587,7 @@ for_stmt:
 		yyerror(interp, buff.c_str());
 		YYERROR;
 	}
-	basic::for_stmt* pObj = new basic::for_stmt(interp->get_current_block(), pVar);
+	basic::for_stmt* pObj = interp->create<basic::for_stmt>(interp, interp->get_current_block(), pVar);
 	pObj->set_condition($4, $6, $8);
 	$$ = pObj;
 }
@@ -295,11 +601,102 @@ for_stmt:
 		yyerror(interp, strErr.c_str());
 		YYERROR;
 	}
+	// Next closes the innermost block, it must be this For
+	if (pObj != interp->last_context())
+	{
+	    std::string strErr("Next ");
+		strErr += $2;
+		strErr += ": the block inside the For is not closed";
+		yyerror(interp, strErr.c_str());
+		YYERROR;
+	}
 	pObj->write_next();
 	$$ = pObj;
 }
 ;
 
+do_stmt:
+	DO {
+	$$ = interp->create<basic::do_stmt>(interp, interp->get_current_block(), false);
+}
+|   DO do_test {
+    // the condition goes into the test block
+	$<doStmt>$ = interp->create<basic::do_stmt>(interp, interp->get_current_block(), true);
+} expr {
+    $<doStmt>3->set_test($4, $2 == UNTIL);
+	$$ = $<doStmt>3;
+}
+|   LOOP {
+    basic::do_stmt* pObj = interp->last_do();
+	if (!pObj)
+	{
+	    yyerror(interp, "Loop without Do");
+		YYERROR;
+	}
+	pObj->make_loop(nullptr, false);
+	$$ = pObj;
+}
+|   LOOP do_test {
+    // the condition goes into the latch
+    $<doStmt>$ = interp->last_do();
+	if (!$<doStmt>$ || !$<doStmt>$->begin_loop_test())
+	{
+	    yyerror(interp, "Loop While/Until without a Do, or after Do While/Until");
+		YYERROR;
+	}
+} expr {
+    $<doStmt>3->make_loop($4, $2 == UNTIL);
+	$$ = $<doStmt>3;
+}
+;
+
+do_test:
+	WHILE { $$ = WHILE; }
+|   UNTIL { $$ = UNTIL; }
+;
+
 %%
 
+static basic::sub_stmt* begin_procedure(basic::interpreter* interp, int tok, const char* name,
+		const basic::param_list* params, int nRetType)
+{
+	basic::sub_stmt* pObj = interp->create<basic::sub_stmt>(interp, tok, name);
+	if (!pObj->define(params ? *params : basic::param_list(), nRetType))
+		return nullptr;
+	return pObj;
+}
+
+// Exit Sub/Function, or End Sub/Function
+static bool end_procedure(basic::interpreter* interp, int tok, bool bExit)
+{
+	basic::sub_stmt* pObj = interp->find_last_sub();
+	if (!pObj || pObj->type() != tok)
+	{
+		yyerror(interp, tok == SUB ? "not inside a Sub" : "not inside a Function");
+		return false;
+	}
+	if (bExit)
+	{
+		pObj->make_exit();
+		return true;
+	}
+	// the blocks inside must be closed first
+	if (interp->last_context() != pObj)
+	{
+		yyerror(interp, "End Sub/Function inside an open block");
+		return false;
+	}
+	interp->pop_context();
+	pObj->make_end();
+	return true;
+}
 
+// The scanner is timed per token only when the time report
+// was asked for, the clock is not free.
+static int yylex(basic_parser_types* lval, basic::interpreter* interp)
+{
+	if (!interp->is_lexer_timing())
+		return basic_lex(lval, interp->get_scanner());
+	basic::phase_timer timer(interp->get_stats(), basic::compile_stats::PHASE_LEX);
+	return basic_lex(lval, interp->get_scanner());
+}
@@ -0,0 +1,68 @@
+#include "basic.h"
+#include "parser.hpp"
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Print
+//
+// Print "n = "; n, x
+//
+// ';' only separates the items, ',' moves to the next tab stop, and a
+// separator at the end keeps the output on the same line. Every item
+// is one call into the runtime (runtime.cpp), which formats it straight
+// into its output buffer. The buffer is flushed when main() returns,
+// or after every statement in incremental mode.
+/////////////////////////////////////////////////////////////////////////
+
+bool interpreter::print_value(Value* pVal)
+{
+	construct_scope cs(m_stats, compile_stats::CONSTRUCT_CALL);
+	ir_builder builder(m_activeBlock);
+	Type* voidType = builder.getVoidTy();
+	m_printUsed = true;
+
+	if (is_string(pVal))
+	{
+		call_runtime(builder, "basic_print_str", voidType, pVal);
+		return true;
+	}
+
+	Type* t = pVal->getType();
+	if (is_variable(pVal))
+	{
+		t = get_variable_type(pVal);
+		pVal = builder.CreateLoad(pVal);
+	}
+
+	if (t->isIntegerTy(1))
+	{
+		Value* pText = builder.CreateSelect(pVal, make_string_literal("True"), make_string_literal("False"));
+		call_runtime(builder, "basic_print_str", voidType, pText);
+	}
+	else if (t->isIntegerTy())
+	{
+		if (t != builder.getInt64Ty())
+			pVal = builder.CreateIntCast(pVal, builder.getInt64Ty(), is_signed_type(t));
+		call_runtime(builder, "basic_print_long", voidType, pVal);
+	}
+	else if (t->isFloatTy())
+		call_runtime(builder, "basic_print_single", voidType, pVal);
+	else if (t->isDoubleTy())
+		call_runtime(builder, "basic_print_double", voidType, pVal);
+	else
+	{
+		std::cerr << "error: Print: this value cannot be printed.\n";
+		return false;
+	}
+	return true;
+}
+
+void interpreter::print_char(char c)
+{
+	construct_scope cs(m_stats, compile_stats::CONSTRUCT_CALL);
+	ir_builder builder(m_activeBlock);
+	m_printUsed = true;
+	call_runtime(builder, "basic_print_char", builder.getVoidTy(), builder.getInt32(c));
+}
@@ -0,0 +1,438 @@
+#include "runtime.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+/////////////////////////////////////////////////////////////////////////
+// String runtime
+//
+// The generated code keeps its String variables and temporaries in
+// place for the whole function, so a buffer that is big enough is
+// simply reused: a concatenation in a loop stops allocating once the
+// temporaries have grown. Short strings never touch the heap at all.
+/////////////////////////////////////////////////////////////////////////
+
+static const int64_t SSO_CAPACITY = sizeof(((basic_string*)0)->sso);
+
+static inline char* str_data(basic_string* s)
+{
+	return s->cap == 0 ? s->sso : s->ref.ptr;
+}
+
+static inline const char* str_data(const basic_string* s)
+{
+	return s->cap == 0 ? s->sso : s->ref.ptr;
+}
+
+// make room for n characters and the NUL in writable storage,
+// bKeep copies the current characters over when the storage moves
+static char* str_reserve(basic_string* s, int64_t n, bool bKeep)
+{
+	if (s->cap > n)
+		return s->ref.ptr;
+
+	if (s->cap <= 0 && n < SSO_CAPACITY)
+	{
+		if (s->cap < 0)
+		{
+			// a literal, copy it into the string itself
+			const char* src = s->ref.ptr;
+			int64_t len = s->len;
+			if (bKeep)
+				memmove(s->sso, src, len);
+			s->cap = 0;
+		}
+		return s->sso;
+	}
+
+	// grow geometrically, appending in a loop stays linear
+	int64_t cap = n + 1;
+	if (cap < 2 * s->cap)
+		cap = 2 * s->cap;
+	if (cap < 32)
+		cap = 32;
+	char* p = static_cast<char*>(malloc(cap));
+	if (bKeep)
+		memcpy(p, str_data(s), s->len);
+	if (s->cap > 0)
+		free(s->ref.ptr);
+	s->ref.ptr = p;
+	s->cap = cap;
+	return p;
+}
+
+void basic_str_assign(basic_string* dst, const basic_string* src)
+{
+	if (dst == src)
+		return;
+
+	// a long literal is borrowed, unless we already have room for it
+	if (src->cap < 0 && src->len >= SSO_CAPACITY && dst->cap <= src->len)
+	{
+		basic_str_free(dst);
+		*dst = *src;
+		return;
+	}
+
+	char* p = str_reserve(dst, src->len, false);
+	memcpy(p, str_data(src), src->len);
+	p[src->len] = '\0';
+	dst->len = src->len;
+}
+
+void basic_str_concat(basic_string* dst, const basic_string* a, const basic_string* b)
+{
+	int64_t la = a->len;
+	int64_t lb = b->len;
+	int64_t n = la + lb;
+
+	if (dst == a)
+	{
+		// s = s & x, and s = s & s
+		char* p = str_reserve(dst, n, true);
+		memmove(p + la, b == dst ? p : str_data(b), lb);
+		p[n] = '\0';
+		dst->len = n;
+		return;
+	}
+
+	if (dst == b)
+	{
+		// s = x & s, shift s to the right
+		char* p = str_reserve(dst, n, true);
+		memmove(p + la, p, lb);
+		memcpy(p, str_data(a), la);
+		p[n] = '\0';
+		dst->len = n;
+		return;
+	}
+
+	char* p = str_reserve(dst, n, false);
+	memcpy(p, str_data(a), la);
+	memcpy(p + la, str_data(b), lb);
+	p[n] = '\0';
+	dst->len = n;
+}
+
+void basic_str_mid(basic_string* dst, const basic_string* s, int64_t start, int64_t len)
+{
+	if (start < 1)
+		start = 1;
+	int64_t offset = start - 1;
+	if (offset > s->len)
+		offset = s->len;
+	if (len < 0 || len > s->len - offset)
+		len = s->len - offset;
+
+	if (dst == s)
+	{
+		// shrinking in place
+		char* p = str_reserve(dst, dst->len, true);
+		memmove(p, p + offset, len);
+		p[len] = '\0';
+		dst->len = len;
+		return;
+	}
+
+	char* p = str_reserve(dst, len, false);
+	memcpy(p, str_data(s) + offset, len);
+	p[len] = '\0';
+	dst->len = len;
+}
+
+int64_t basic_str_instr(int64_t start, const basic_string* s, const basic_string* find)
+{
+	if (start < 1)
+		start = 1;
+	if (start - 1 > s->len)
+		return 0;
+	if (find->len == 0)
+		return start;
+	const char* base = str_data(s);
+	const void* found = memmem(base + start - 1, s->len - (start - 1), str_data(find), find->len);
+	if (!found)
+		return 0;
+	return static_cast<const char*>(found) - base + 1;
+}
+
+int64_t basic_str_compare(const basic_string* a, const basic_string* b)
+{
+	int64_t n = a->len < b->len ? a->len : b->len;
+	int result = memcmp(str_data(a), str_data(b), n);
+	if (result)
+		return result;
+	return a->len - b->len;
+}
+
+const char* basic_str_data(const basic_string* s)
+{
+	return str_data(s);
+}
+
+void basic_str_move(basic_string* dst, basic_string* src)
+{
+	if (dst == src)
+		return;
+	basic_str_free(dst);
+	*dst = *src;
+	src->len = 0;
+	src->cap = 0;
+	src->sso[0] = '\0';
+}
+
+void basic_str_free(basic_string* s)
+{
+	if (s->cap > 0)
+		free(s->ref.ptr);
+	s->len = 0;
+	s->cap = 0;
+	s->sso[0] = '\0';
+}
+
+void basic_str_free_array(basic_string* a, int64_t n)
+{
+	for (int64_t i = 0; i < n; i++)
+		basic_str_free(&a[i]);
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Print
+//
+// One big buffer and write(2), instead of a stdio call per item. The
+// numbers are formatted straight into the buffer: the integers two
+// digits at a time, the floating-point values with the fewest digits
+// that still read back as the same value.
+/////////////////////////////////////////////////////////////////////////
+
+static char s_output[64 * 1024];
+static size_t s_outputUsed = 0;
+static bool s_atexit = false;
+
+static void out_write(const char* p, size_t n)
+{
+	while (n)
+	{
+		ssize_t written = write(1, p, n);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		p += written;
+		n -= written;
+	}
+}
+
+void basic_print_flush()
+{
+	out_write(s_output, s_outputUsed);
+	s_outputUsed = 0;
+}
+
+// room for n more bytes in the buffer
+static inline char* out_reserve(size_t n)
+{
+	if (!s_atexit)
+	{
+		// whatever is left when the program ends
+		atexit(basic_print_flush);
+		s_atexit = true;
+	}
+	if (s_outputUsed + n > sizeof(s_output))
+		basic_print_flush();
+	return s_output + s_outputUsed;
+}
+
+static void out_text(const char* p, size_t len)
+{
+	memcpy(out_reserve(len), p, len);
+	s_outputUsed += len;
+}
+
+static const char s_digitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+// writes the digits backwards, ending at end, returns the first one
+static inline char* format_unsigned(char* end, uint64_t n)
+{
+	while (n >= 100)
+	{
+		const char* pair = s_digitPairs + (n % 100) * 2;
+		n /= 100;
+		*--end = pair[1];
+		*--end = pair[0];
+	}
+	if (n >= 10)
+	{
+		const char* pair = s_digitPairs + n * 2;
+		*--end = pair[1];
+		*--end = pair[0];
+	}
+	else
+		*--end = static_cast<char>('0' + n);
+	return end;
+}
+
+void basic_print_long(int64_t n)
+{
+	char digits[24];
+	char* end = digits + sizeof(digits);
+	uint64_t u = n < 0 ? 0 - static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+	char* p = format_unsigned(end, u);
+	if (n < 0)
+		*--p = '-';
+	out_text(p, end - p);
+}
+
+// the shortest text that reads back as the same value: std::to_chars
+// (Ryu) where we have it. Otherwise a bounded retry loop, from the
+// precision that is always exact for the type (digits10) up to the one
+// that always reads back, one snprintf and strtod per precision tried.
+static void print_float(double d, int nMin, int nMax, bool bSingle)
+{
+	if (isnan(d))
+	{
+		out_text("NaN", 3);
+		return;
+	}
+	if (isinf(d))
+	{
+		out_text(d < 0 ? "-Inf" : "Inf", d < 0 ? 4 : 3);
+		return;
+	}
+	// the integral values are common, and the integer path is much faster
+	if (d == trunc(d) && fabs(d) < 1e15)
+	{
+		basic_print_long(static_cast<int64_t>(d));
+		return;
+	}
+
+	char* p = out_reserve(32);
+#ifdef BASIC_RUNTIME_TO_CHARS
+	// the precisions are only for the retry loop
+	(void)nMin;
+	(void)nMax;
+	std::to_chars_result result = bSingle ? std::to_chars(p, p + 32, static_cast<float>(d))
+		: std::to_chars(p, p + 32, d);
+	s_outputUsed += result.ptr - p;
+#else
+	int len = 0;
+	for (int prec = nMin; prec <= nMax; prec++)
+	{
+		len = snprintf(p, 32, "%.*g", prec, d);
+		if (bSingle ? strtof(p, nullptr) == static_cast<float>(d) : strtod(p, nullptr) == d)
+			break;
+	}
+	s_outputUsed += len;
+#endif
+}
+
+void basic_print_double(double d)
+{
+	print_float(d, 15, 17, false);
+}
+
+void basic_print_single(float f)
+{
+	print_float(f, 6, 9, true);
+}
+
+void basic_print_str(const basic_string* s)
+{
+	const char* p = str_data(s);
+	size_t len = s->len;
+	if (len > sizeof(s_output) / 2)
+	{
+		// not worth copying
+		basic_print_flush();
+		out_write(p, len);
+		return;
+	}
+	out_text(p, len);
+}
+
+void basic_print_char(int c)
+{
+	*out_reserve(1) = static_cast<char>(c);
+	s_outputUsed++;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Math
+/////////////////////////////////////////////////////////////////////////
+
+int64_t basic_pow_long(int64_t base, int64_t exp)
+{
+	if (exp < 0)
+	{
+		if (base == 1)
+			return 1;
+		if (base == -1)
+			return (exp & 1) ? -1 : 1;
+		return 0;
+	}
+	// unsigned, so the overflow wraps instead of being undefined
+	uint64_t result = 1;
+	uint64_t square = static_cast<uint64_t>(base);
+	while (exp)
+	{
+		if (exp & 1)
+			result *= square;
+		exp >>= 1;
+		square *= square;
+	}
+	return static_cast<int64_t>(result);
+}
+
+// set by the interpreter around the code it runs, so an error ends
+// the BASIC program and not the session. The generated code owns
+// nothing that needs unwinding, its buffers leak at worst.
+static jmp_buf* s_errorJump = nullptr;
+
+void basic_set_error_jump(jmp_buf* pJump)
+{
+	s_errorJump = pJump;
+}
+
+// nCode is the error number of the Microsoft BASICs
+static void runtime_error(const char* msg, size_t len, int nCode)
+{
+	// what was printed so far comes first
+	basic_print_flush();
+	ssize_t written = write(2, msg, len);
+	(void)written;
+	if (s_errorJump)
+		longjmp(*s_errorJump, nCode);
+	exit(nCode);
+}
+
+void basic_overflow_error()
+{
+	static const char msg[] = "error: arithmetic overflow\n";
+	runtime_error(msg, sizeof(msg) - 1, 6);
+}
+
+void basic_index_error()
+{
+	static const char msg[] = "error: subscript out of range\n";
+	runtime_error(msg, sizeof(msg) - 1, 9);
+}
+
+void basic_memory_error()
+{
+	static const char msg[] = "error: out of memory\n";
+	runtime_error(msg, sizeof(msg) - 1, 7);
+}
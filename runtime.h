@@ -0,0 +1,85 @@
+#ifndef BASIC_RUNTIME_H
+#define BASIC_RUNTIME_H
+
+// The runtime library called by the generated code.
+// It is linked into the interpreter itself for the JIT (exported with
+// -rdynamic), and built as libbasicrt.a for the native executables.
+//
+// The executables are linked by the C driver. Only Print may need the
+// C++ runtime: std::to_chars gives the shortest digits of a Double or a
+// Single, where the standard library has it for floating point
+// (BASIC_RUNTIME_TO_CHARS), and then libstdc++ is linked in too.
+
+#include <stdint.h>
+#include <setjmp.h>
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#if defined(__cpp_lib_to_chars)
+#define BASIC_RUNTIME_TO_CHARS 1
+#endif
+
+extern "C"
+{
+	// A BASIC String, the generated code sees it as { i64, i64, i8*, i64 }.
+	//   cap == 0   the characters are in sso (up to 15 and the NUL)
+	//   cap > 0    owned heap block of cap bytes
+	//   cap == -1  borrowed, ptr is a literal in the module
+	// The characters are always followed by a NUL, so data() can be
+	// handed over to the C functions as is.
+	struct basic_string
+	{
+		int64_t len;
+		int64_t cap;
+		union
+		{
+			struct
+			{
+				char* ptr;
+				int64_t unused;
+			} ref;
+			char sso[16];
+		};
+	};
+
+	void basic_str_assign(basic_string* dst, const basic_string* src);
+	// dst may be a or b, s = s & x appends in place
+	void basic_str_concat(basic_string* dst, const basic_string* a, const basic_string* b);
+	// 1-based, a negative length takes the rest of the string
+	void basic_str_mid(basic_string* dst, const basic_string* s, int64_t start, int64_t len);
+	// 1-based position of find in s, from start, or 0
+	int64_t basic_str_instr(int64_t start, const basic_string* s, const basic_string* find);
+	int64_t basic_str_compare(const basic_string* a, const basic_string* b);
+	const char* basic_str_data(const basic_string* s);
+	// dst takes over the characters of src, src is left empty
+	void basic_str_move(basic_string* dst, basic_string* src);
+	void basic_str_free(basic_string* s);
+	// the n elements of a String array, before it is freed or replaced
+	void basic_str_free_array(basic_string* a, int64_t n);
+
+	// Print, into a 64 KiB buffer written to stdout when it is full,
+	// by basic_print_flush(), and at exit
+	void basic_print_long(int64_t n);
+	// the shortest text that reads back as the same value
+	void basic_print_double(double d);
+	void basic_print_single(float f);
+	void basic_print_str(const basic_string* s);
+	void basic_print_char(int c);
+	void basic_print_flush();
+
+	// Integer ^ Integer, wraps around like *, a negative exponent
+	// truncates toward zero (0 unless base is 1 or -1)
+	int64_t basic_pow_long(int64_t base, int64_t exp);
+	// --checked-arith: an Integer/Long overflow ends the program,
+	// an executable exits with status 6, and under the JIT it jumps
+	// back to the host set with basic_set_error_jump()
+	void basic_overflow_error();
+	// an array index past the elements (status 9), or an array
+	// that could not be allocated (status 7), the same way
+	void basic_index_error();
+	void basic_memory_error();
+	// the JIT host catches the runtime errors here, null to exit()
+	void basic_set_error_jump(jmp_buf* pJump);
+}
+
+#endif /* BASIC_RUNTIME_H */
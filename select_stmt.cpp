@@ -0,0 +1,231 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <llvm/ADT/SmallSet.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Select Case
+//
+// Select Case x
+// Case 1, 3, 5       <- list
+//     ...
+// Case 10 To 20      <- range
+//     ...
+// Case Else
+//     ...
+// End Select
+//
+// The first arm that matches runs, then the control goes to End Select.
+// Every arm gets a test block, where its Case values are evaluated, and
+// a body block. Nothing is chained before End Select, when we know all
+// the arms: consecutive arms with only Integer/Long constants (and small
+// constant ranges) become one llvm switch, which the backend turns into
+// a jump table or a binary search. Any other arm compares the selector
+// with its values, and falls through to the next arm when none matches.
+/////////////////////////////////////////////////////////////////////////
+
+// a constant range is only expanded into switch cases up to this size
+static const int64_t MAX_RANGE_CASES = 256;
+
+select_stmt::select_stmt(interpreter* pInterp, BasicBlock* parent, Value* selector)
+	: statement(pInterp, SELECT, "Select")
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_SELECT);
+	m_parentBlock = parent;
+	m_exitBlock = BasicBlock::Create(*m_interp, "", parent->getParent());
+	m_elseBlock = nullptr;
+
+	// evaluated once, a String is compared through its pointer
+	m_selector = selector;
+	if (m_interp->is_variable(selector) && !m_interp->is_string(selector))
+	{
+		ir_builder builder(parent);
+		m_selector = builder.CreateLoad(selector);
+	}
+	// until the first Case, the parent block is still the current one
+	m_interp->push_context(this);
+}
+
+select_stmt::~select_stmt()
+{
+	//
+}
+
+bool select_stmt::begin_case()
+{
+	if (m_elseBlock)
+		return false;
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_SELECT);
+	Function* f = m_parentBlock->getParent();
+	// the previous arm is done
+	close_values();
+	if (!m_arms.empty())
+	{
+		ir_builder builder(m_interp->get_current_block());
+		builder.CreateBr(m_exitBlock);
+	}
+	arm a;
+	a.testEntry = BasicBlock::Create(*m_interp, "", f);
+	a.testEnd = a.body = nullptr;
+	m_arms.push_back(a);
+	m_interp->set_current_block(a.testEntry);
+	return true;
+}
+
+void select_stmt::set_case(const case_list& items)
+{
+	arm& a = m_arms.back();
+	a.testEnd = m_interp->get_current_block();
+	a.items = items;
+	a.body = BasicBlock::Create(*m_interp, "", m_parentBlock->getParent());
+	m_interp->set_current_block(a.body);
+}
+
+// after a syntax error in the values, the arm never matches
+void select_stmt::close_values()
+{
+	if (!m_arms.empty() && !m_arms.back().body)
+		set_case(case_list());
+}
+
+bool select_stmt::set_case_else()
+{
+	if (m_elseBlock)
+		return false;
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_SELECT);
+	close_values();
+	if (!m_arms.empty())
+	{
+		ir_builder builder(m_interp->get_current_block());
+		builder.CreateBr(m_exitBlock);
+	}
+	m_elseBlock = BasicBlock::Create(*m_interp, "", m_parentBlock->getParent());
+	m_interp->set_current_block(m_elseBlock);
+	return true;
+}
+
+// the value of an integer constant, as the selector type,
+// false if it does not fit (so it never matches)
+static bool case_value(ConstantInt* c, IntegerType* t, int64_t& nValue)
+{
+	nValue = is_signed_type(c->getType()) ? c->getSExtValue() : static_cast<int64_t>(c->getZExtValue());
+	unsigned nBits = t->getBitWidth();
+	if (is_signed_type(t))
+		return isIntN(nBits, nValue);
+	return nValue >= 0 && isUIntN(nBits, nValue);
+}
+
+bool select_stmt::get_switch_cases(const arm& a, SmallVectorImpl<ConstantInt*>& cases)
+{
+	Type* t = m_selector->getType();
+	if (!t->isIntegerTy())
+		return false;
+	// the values made instructions (a variable, a call, ...)
+	if (a.testEntry != a.testEnd || !a.testEntry->empty())
+		return false;
+
+	IntegerType* it = static_cast<IntegerType*>(t);
+	for (auto& item: a.items)
+	{
+		if (!ConstantInt::classof(item.first) || (item.second && !ConstantInt::classof(item.second)))
+			return false;
+		int64_t nLow = 0, nHigh = 0;
+		bool bLow = case_value(static_cast<ConstantInt*>(item.first), it, nLow);
+		if (!item.second)
+		{
+			if (bLow)
+				cases.push_back(ConstantInt::get(it, nLow, is_signed_type(it)));
+			continue;
+		}
+		bool bHigh = case_value(static_cast<ConstantInt*>(item.second), it, nHigh);
+		// a range sticking out of the selector type is compared
+		if (!bLow || !bHigh)
+			return false;
+		if (nHigh >= nLow && nHigh - nLow >= MAX_RANGE_CASES)
+			return false;
+		for (int64_t n = nLow; n <= nHigh; n++)
+			cases.push_back(ConstantInt::get(it, n, is_signed_type(it)));
+	}
+	return true;
+}
+
+void select_stmt::make_end_select()
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_SELECT);
+	close_values();
+	ir_builder builder(m_interp->get_current_block());
+	// the last arm is done
+	if (!m_arms.empty() || m_elseBlock)
+		builder.CreateBr(m_exitBlock);
+
+	// built backwards, so every test knows where to go when it fails
+	BasicBlock* pNext = m_elseBlock ? m_elseBlock : m_exitBlock;
+	SmallVector<ConstantInt*, 16> cases;
+	size_t i = m_arms.size();
+	while (i > 0)
+	{
+		arm& a = m_arms[i - 1];
+		cases.clear();
+		if (!get_switch_cases(a, cases))
+		{
+			// selector = v Or (selector >= lo And selector <= hi) ...
+			m_interp->set_current_block(a.testEnd);
+			Value* cond = nullptr;
+			for (auto& item: a.items)
+			{
+				Value* pMatch = nullptr;
+				if (item.second)
+					pMatch = m_interp->make_logical(Instruction::And,
+							m_interp->make_comparison(m_selector, item.first, CmpInst::ICMP_SGE),
+							m_interp->make_comparison(m_selector, item.second, CmpInst::ICMP_SLE));
+				else
+					pMatch = m_interp->make_comparison(m_selector, item.first, CmpInst::ICMP_EQ);
+				cond = cond ? m_interp->make_logical(Instruction::Or, cond, pMatch) : pMatch;
+			}
+			builder.SetInsertPoint(m_interp->get_current_block());
+			if (!cond)
+				cond = builder.getFalse();
+			builder.CreateCondBr(cond, a.body, pNext);
+			pNext = a.testEntry;
+			i--;
+			continue;
+		}
+
+		// the run of constant arms ending here shares one switch,
+		// in the test block of its first arm
+		size_t nLast = i;
+		while (i > 1)
+		{
+			SmallVector<ConstantInt*, 16> prev;
+			if (!get_switch_cases(m_arms[i - 2], prev))
+				break;
+			i--;
+		}
+		BasicBlock* bb = m_arms[i - 1].testEntry;
+		builder.SetInsertPoint(bb);
+		SwitchInst* sw = builder.CreateSwitch(m_selector, pNext);
+		// a value taken by an earlier arm stays with it
+		SmallSet<int64_t, 16> seen;
+		for (size_t n = i; n <= nLast; n++)
+		{
+			arm& ar = m_arms[n - 1];
+			cases.clear();
+			get_switch_cases(ar, cases);
+			for (auto c: cases)
+			{
+				if (seen.insert(c->getSExtValue()).second)
+					sw->addCase(c, ar.body);
+			}
+			if (ar.testEntry != bb)
+				ar.testEntry->eraseFromParent();
+		}
+		pNext = bb;
+		i--;
+	}
+
+	builder.SetInsertPoint(m_parentBlock);
+	builder.CreateBr(pNext);
+	m_interp->set_current_block(m_exitBlock);
+}
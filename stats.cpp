@@ -0,0 +1,112 @@
+#include "basic.h"
+#include <iomanip>
+
+using namespace basic;
+using namespace llvm;
+
+compile_stats::compile_stats()
+{
+	for (auto& s: m_seconds)
+		s = 0.0;
+	for (auto& n: m_instructions)
+		n = 0;
+	m_statements = m_casts = m_lookups = 0;
+	m_construct = CONSTRUCT_EXPR;
+}
+
+const char* compile_stats::phase_name(phase p)
+{
+	static const char* names[PHASE_COUNT] = {
+		"lex", "parse", "link", "verify", "optimize", "print", "codegen", "jit", "execute"
+	};
+	return names[p];
+}
+
+const char* compile_stats::construct_name(construct c)
+{
+	static const char* names[CONSTRUCT_COUNT] = {
+		"expr", "dim", "for", "if", "call", "select", "do"
+	};
+	return names[c];
+}
+
+long compile_stats::get_total_instructions() const
+{
+	long total = 0;
+	for (auto n: m_instructions)
+		total += n;
+	return total;
+}
+
+void compile_stats::print_time_report(std::ostream& os) const
+{
+	double total = 0.0;
+	for (auto s: m_seconds)
+		total += s;
+
+	os << "===---------------------------------------------===\n"
+		<< "                 Time report\n"
+		<< "===---------------------------------------------===\n"
+		<< "   Wall Time (ms)      %   Phase\n";
+	os << std::fixed;
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		double percent = total > 0.0 ? m_seconds[p] * 100.0 / total : 0.0;
+		os << std::setw(16) << std::setprecision(3) << m_seconds[p] * 1000.0
+			<< std::setw(8) << std::setprecision(1) << percent
+			<< "   " << phase_name(static_cast<phase>(p)) << "\n";
+	}
+	os << std::setw(16) << std::setprecision(3) << total * 1000.0
+		<< std::setw(8) << std::setprecision(1) << 100.0 << "   total\n";
+	os << std::defaultfloat;
+}
+
+void compile_stats::print_time_report_json(std::ostream& os) const
+{
+	// milliseconds, keyed by the phase names
+	os << "{\"time_report\": {";
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		if (p)
+			os << ", ";
+		os << "\"" << phase_name(static_cast<phase>(p)) << "\": " << m_seconds[p] * 1000.0;
+	}
+	os << "}}\n";
+}
+
+void compile_stats::print_stats(std::ostream& os) const
+{
+	os << "===---------------------------------------------===\n"
+		<< "                 Statistics\n"
+		<< "===---------------------------------------------===\n";
+	os << std::setw(10) << m_statements << "  statements parsed\n";
+	for (int c = 0; c < CONSTRUCT_COUNT; c++)
+	{
+		os << std::setw(10) << m_instructions[c] << "  instructions emitted for "
+			<< construct_name(static_cast<construct>(c)) << "\n";
+	}
+	os << std::setw(10) << get_total_instructions() << "  instructions emitted\n"
+		<< std::setw(10) << m_casts << "  casts inserted\n"
+		<< std::setw(10) << m_lookups << "  symbol lookups\n";
+}
+
+void compile_stats::print_stats_json(std::ostream& os) const
+{
+	os << "{\"stats\": {\"statements\": " << m_statements
+		<< ", \"instructions\": {";
+	for (int c = 0; c < CONSTRUCT_COUNT; c++)
+		os << "\"" << construct_name(static_cast<construct>(c)) << "\": " << m_instructions[c] << ", ";
+	os << "\"total\": " << get_total_instructions() << "}"
+		<< ", \"casts\": " << m_casts
+		<< ", \"lookups\": " << m_lookups << "}}\n";
+}
+
+void counting_inserter::InsertHelper(Instruction* I, const Twine& Name,
+		BasicBlock* BB, BasicBlock::iterator InsertPt) const
+{
+	IRBuilderDefaultInserter::InsertHelper(I, Name, BB, InsertPt);
+	// every instruction we make belongs to the interpreter's context
+	interpreter& bi = interpreter::from_context(I->getContext());
+	bi.get_stats().count_instruction();
+	bi.annotate_access(I);
+}
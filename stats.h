@@ -0,0 +1,113 @@
+#ifndef BASIC_STATS_H
+#define BASIC_STATS_H
+
+// Phase timing and counters for --time-report and --stats.
+//
+// The phases are timed with the wall clock, the lexer is only timed
+// (per token) when the time report was asked for.
+
+#include <chrono>
+#include <ostream>
+
+namespace basic
+{
+	class compile_stats
+	{
+	public:
+		enum phase
+		{
+			PHASE_LEX,
+			PHASE_PARSE,     // parsing and IR building, they are interleaved
+			PHASE_LINK,      // the precompiled libraries
+			PHASE_VERIFY,
+			PHASE_OPTIMIZE,
+			PHASE_PRINT,
+			PHASE_CODEGEN,
+			PHASE_JIT,
+			PHASE_EXECUTE,
+			PHASE_COUNT
+		};
+
+		// what the instructions are emitted for
+		enum construct
+		{
+			CONSTRUCT_EXPR,
+			CONSTRUCT_DIM,
+			CONSTRUCT_FOR,
+			CONSTRUCT_IF,
+			CONSTRUCT_CALL,
+			CONSTRUCT_SELECT,
+			CONSTRUCT_DO,
+			CONSTRUCT_COUNT
+		};
+
+		compile_stats();
+
+		void add_time(phase p, double seconds) { m_seconds[p] += seconds; }
+		double get_time(phase p) const { return m_seconds[p]; }
+
+		void count_statement() { m_statements++; }
+		void count_instruction() { m_instructions[m_construct]++; }
+		void count_cast() { m_casts++; }
+		void count_lookup() { m_lookups++; }
+
+		construct get_construct() const { return m_construct; }
+		void set_construct(construct c) { m_construct = c; }
+
+		long get_statements() const { return m_statements; }
+		long get_instructions(construct c) const { return m_instructions[c]; }
+		long get_total_instructions() const;
+		long get_casts() const { return m_casts; }
+		long get_lookups() const { return m_lookups; }
+
+		void print_time_report(std::ostream& os) const;
+		void print_time_report_json(std::ostream& os) const;
+		void print_stats(std::ostream& os) const;
+		void print_stats_json(std::ostream& os) const;
+
+		static const char* phase_name(phase p);
+		static const char* construct_name(construct c);
+
+	private:
+		double m_seconds[PHASE_COUNT];
+		long m_instructions[CONSTRUCT_COUNT];
+		long m_statements;
+		long m_casts;
+		long m_lookups;
+		construct m_construct;
+	};
+
+	// times a phase for as long as it lives
+	class phase_timer
+	{
+	public:
+		phase_timer(compile_stats& stats, compile_stats::phase p)
+			: m_stats(stats), m_phase(p), m_start(std::chrono::steady_clock::now()) {}
+		~phase_timer()
+		{
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+			m_stats.add_time(m_phase, elapsed.count());
+		}
+
+	private:
+		compile_stats& m_stats;
+		compile_stats::phase m_phase;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+	// the instructions emitted while it lives are counted for c
+	class construct_scope
+	{
+	public:
+		construct_scope(compile_stats& stats, compile_stats::construct c)
+			: m_stats(stats), m_prev(stats.get_construct())
+		{ m_stats.set_construct(c); }
+		~construct_scope() { m_stats.set_construct(m_prev); }
+
+	private:
+		compile_stats& m_stats;
+		compile_stats::construct m_prev;
+	};
+}
+
+#endif /* BASIC_STATS_H */
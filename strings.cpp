@@ -0,0 +1,229 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <cctype>
+#include <strings.h>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Strings
+//
+// A String is a basic_string (runtime.h), the generated code only
+// ever handles pointers to one:
+//   - variables and array elements
+//   - literals, one constant global per distinct text, borrowing
+//     the characters instead of copying them
+//   - temporaries for the results of &, Mid$, ..., one per expression
+//     in the entry block, so a loop reuses the same buffers over and over
+// The variables and temporaries are released when the function returns.
+/////////////////////////////////////////////////////////////////////////
+
+bool interpreter::is_string(Value* pVal)
+{
+	return pVal->getType() == m_stringType->getPointerTo();
+}
+
+Value* interpreter::call_runtime(ir_builder& builder, const char* pszname, Type* retType, ArrayRef<Value*> args)
+{
+	SmallVector<Type*, 4> types;
+	for (auto pArg: args)
+		types.push_back(pArg->getType());
+	Constant* fn = module->getOrInsertFunction(pszname, FunctionType::get(retType, types, false));
+	return builder.CreateCall(fn, args);
+}
+
+Constant* interpreter::make_string_literal(StringRef text)
+{
+	auto found = m_literals.find(text);
+	if (found != m_literals.end())
+		return found->second;
+
+	Type* i64 = Type::getInt64Ty(*this);
+	Constant* chars = ConstantDataArray::getString(*this, text);
+	GlobalVariable* gvChars = new GlobalVariable(*(module.get()), chars->getType(), true,
+			GlobalVariable::PrivateLinkage, chars, ".str");
+	gvChars->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+	Constant* zero = ConstantInt::get(Type::getInt32Ty(*this), 0);
+	Constant* idx[] = { zero, zero };
+	Constant* fields[] = {
+		ConstantInt::get(i64, text.size()),
+		ConstantInt::get(i64, -1, true),    // borrowed
+		ConstantExpr::getInBoundsGetElementPtr(chars->getType(), gvChars, idx),
+		ConstantInt::get(i64, 0)
+	};
+	GlobalVariable* gv = new GlobalVariable(*(module.get()), m_stringType, true,
+			GlobalVariable::PrivateLinkage, ConstantStruct::get(m_stringType, fields), ".bstr");
+	m_literals[text] = gv;
+	return gv;
+}
+
+Value* interpreter::make_string_temp()
+{
+	BasicBlock* entry = &(get_current_function()->getEntryBlock());
+	ir_builder builder(entry, entry->getFirstInsertionPt());
+	AllocaInst* pTemp = builder.CreateAlloca(m_stringType, nullptr, "str.tmp");
+	builder.CreateStore(Constant::getNullValue(m_stringType), pTemp);
+	m_stringTemps.insert(pTemp);
+	m_stringSlots.push_back(pTemp);
+	return pTemp;
+}
+
+Value* interpreter::string_data(Value* pStr, ir_builder& builder)
+{
+	// a literal hands out its characters directly
+	if (GlobalVariable::classof(pStr))
+	{
+		GlobalVariable* gv = static_cast<GlobalVariable*>(pStr);
+		if (gv->isConstant() && gv->hasInitializer())
+			return gv->getInitializer()->getAggregateElement(2u);
+	}
+	return call_runtime(builder, "basic_str_data", builder.getInt8PtrTy(), pStr);
+}
+
+Value* interpreter::string_length(Value* pStr, ir_builder& builder)
+{
+	if (GlobalVariable::classof(pStr))
+	{
+		GlobalVariable* gv = static_cast<GlobalVariable*>(pStr);
+		if (gv->isConstant() && gv->hasInitializer())
+			return gv->getInitializer()->getAggregateElement(0u);
+	}
+	return builder.CreateLoad(builder.CreateStructGEP(m_stringType, pStr, 0));
+}
+
+Value* interpreter::make_concat(Value* lhs, Value* rhs)
+{
+	if (!is_string(lhs) || !is_string(rhs))
+	{
+		std::cerr << "error: type mismatch, & needs two Strings\n";
+		add_error();
+		return make_string_temp();
+	}
+	Value* pTemp = make_string_temp();
+	ir_builder builder(m_activeBlock);
+	Value* args[] = { pTemp, lhs, rhs };
+	call_runtime(builder, "basic_str_concat", builder.getVoidTy(), args);
+	return pTemp;
+}
+
+Value* interpreter::make_string_compare(Value* lhs, Value* rhs, CmpInst::Predicate pred)
+{
+	ir_builder builder(m_activeBlock);
+	if (!is_string(lhs) || !is_string(rhs))
+	{
+		std::cerr << "error: type mismatch, a String can only be compared with a String\n";
+		add_error();
+		return builder.getFalse();
+	}
+	Value* args[] = { lhs, rhs };
+	Value* pResult = call_runtime(builder, "basic_str_compare", builder.getInt64Ty(), args);
+	return builder.CreateICmp(pred, pResult, builder.getInt64(0));
+}
+
+Value* interpreter::assign_string(Value* pVar, Value* pVal)
+{
+	if (!is_string(pVal))
+	{
+		std::cerr << "error: type mismatch, only a String can be assigned to a String\n";
+		add_error();
+		return pVal;
+	}
+
+	// s = s & x: let the concatenation write into s,
+	// it appends in place instead of copying s every time
+	if (m_stringTemps.count(pVal) && !m_activeBlock->empty() && CallInst::classof(&m_activeBlock->back()))
+	{
+		CallInst* call = static_cast<CallInst*>(&m_activeBlock->back());
+		Function* fn = call->getCalledFunction();
+		if (fn && fn->getName() == "basic_str_concat"
+				&& call->getArgOperand(0) == pVal && call->getArgOperand(1) == pVar)
+		{
+			call->setArgOperand(0, pVar);
+			return call;
+		}
+	}
+
+	ir_builder builder(m_activeBlock);
+	Value* args[] = { pVar, pVal };
+	return call_runtime(builder, "basic_str_assign", builder.getVoidTy(), args);
+}
+
+bool interpreter::is_builtin(const char* pszname)
+{
+	static const char* names[] = { "len", "mid$", "mid", "left$", "left", "instr" };
+	for (auto name: names)
+	{
+		if (!strcasecmp(pszname, name))
+			return true;
+	}
+	return false;
+}
+
+Value* interpreter::make_builtin(const char* pszname, const value_list& args)
+{
+	std::string strName(pszname);
+	for (auto& c: strName)
+		c = tolower(static_cast<unsigned char>(c));
+	if (strName.back() == '$')
+		strName.pop_back();
+
+	// the String argument, then the numbers
+	size_t nMin = 2, nMax = 2;
+	if (strName == "len")
+		nMin = nMax = 1;
+	else if (strName == "mid" || strName == "instr")
+		nMax = 3;
+	if (args.size() < nMin || args.size() > nMax)
+	{
+		std::cerr << "error: " << pszname << " expects " << nMin;
+		if (nMax > nMin)
+			std::cerr << " or " << nMax;
+		std::cerr << " arguments.\n";
+		return nullptr;
+	}
+
+	// InStr([start,] s, find)
+	size_t nFirst = (strName == "instr" && args.size() == 3) ? 1 : 0;
+	if (!is_string(args[nFirst]) || (strName == "instr" && !is_string(args[nFirst + 1])))
+	{
+		std::cerr << "error: type mismatch, " << pszname << " needs a String.\n";
+		return nullptr;
+	}
+
+	ir_builder builder(m_activeBlock);
+	if (strName == "len")
+		return string_length(args[0], builder);
+
+	if (strName == "instr")
+	{
+		Value* pStart = nFirst ? make_index(args[0], builder) : builder.getInt64(1);
+		if (!pStart)
+			return nullptr;
+		Value* callArgs[] = { pStart, args[nFirst], args[nFirst + 1] };
+		return call_runtime(builder, "basic_str_instr", builder.getInt64Ty(), callArgs);
+	}
+
+	// Mid$(s, start[, length]) and Left$(s, length)
+	Value* pStart = builder.getInt64(1);
+	Value* pLength = builder.getInt64(-1);
+	if (strName == "mid")
+	{
+		pStart = make_index(args[1], builder);
+		if (args.size() == 3)
+			pLength = make_index(args[2], builder);
+	}
+	else
+		pLength = make_index(args[1], builder);
+	if (!pStart || !pLength)
+	{
+		std::cerr << "error: " << pszname << " needs a number.\n";
+		return nullptr;
+	}
+
+	Value* pTemp = make_string_temp();
+	Value* callArgs[] = { pTemp, args[0], pStart, pLength };
+	call_runtime(builder, "basic_str_mid", builder.getVoidTy(), callArgs);
+	return pTemp;
+}
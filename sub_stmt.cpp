@@ -0,0 +1,300 @@
+#include "basic.h"
+#include "parser.hpp"
+#include <cctype>
+
+using namespace llvm;
+using namespace basic;
+
+/////////////////////////////////////////////////////////////////////////
+// Sub and Function
+//
+// Function Max(a As Long, b As Long) As Long
+//     Max = a
+//     If b > a Then
+//         Max = b
+//     End If
+// End Function
+//
+// The parameters are passed by value, and they are plain variables
+// in the body. A Function returns the value of the variable named
+// after it, zero unless the body assigned it.
+//
+// Strings are passed by pointer and copied into the parameter. A String
+// Function writes its result into a hidden first parameter (sret) that
+// the caller provides, a temporary of its own.
+//
+// The procedures are internal and use fastcc, so the optimizer is
+// free to inline them and to specialize their arguments. The names
+// get a "basic." prefix, they can never clash with the C functions
+// we call (puts, pow, free, ...).
+/////////////////////////////////////////////////////////////////////////
+
+static std::string procedure_name(const char* pszname)
+{
+	std::string strName("basic.");
+	for (const char* p = pszname; *p; p++)
+		strName += static_cast<char>(tolower(static_cast<unsigned char>(*p)));
+	return strName;
+}
+
+static bool is_procedure(const symbol* sym)
+{
+	return sym->typeId == SUB || sym->typeId == FUNCTION;
+}
+
+sub_stmt::sub_stmt(interpreter* pInterp, int tok, const char* name)
+	: statement(pInterp, tok, name)
+{
+	m_function = nullptr;
+	m_callerBlock = nullptr;
+	m_exitBlock = nullptr;
+	m_retval = nullptr;
+	m_result = nullptr;
+}
+
+sub_stmt::~sub_stmt()
+{
+	//
+}
+
+bool sub_stmt::define(const param_list& params, int nRetType)
+{
+	if (!m_interp->is_statement_complete())
+	{
+		std::cerr << "error: " << m_name << " must be defined at the top level.\n";
+		return false;
+	}
+
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_CALL);
+	std::vector<Type*> types;
+	Type* retType = Type::getVoidTy(*m_interp);
+	bool bStringResult = false;
+	if (m_type == FUNCTION)
+	{
+		retType = m_interp->get_llvm_type(nRetType);
+		if (retType->isStructTy())
+		{
+			bStringResult = true;
+			types.push_back(retType->getPointerTo());
+			retType = Type::getVoidTy(*m_interp);
+		}
+	}
+	for (auto& param: params)
+	{
+		Type* t = m_interp->get_llvm_type(param.second);
+		types.push_back(t->isStructTy() ? t->getPointerTo() : t);
+	}
+
+	m_function = m_interp->create_procedure(m_type, m_name.c_str(),
+			FunctionType::get(retType, types, false));
+	if (!m_function)
+		return false;
+
+	m_callerBlock = m_interp->get_current_block();
+	BasicBlock* entry = BasicBlock::Create(*m_interp, "entry", m_function);
+	m_exitBlock = BasicBlock::Create(*m_interp, "exit", m_function);
+	m_interp->enter_procedure(m_function);
+	m_interp->set_current_block(entry);
+
+	// the arguments are copied into variables, so the body can assign them,
+	// mem2reg turns them back into registers.
+	auto arg = m_function->arg_begin();
+	if (bStringResult)
+	{
+		m_function->addParamAttr(0, Attribute::StructRet);
+		m_function->addParamAttr(0, Attribute::NoAlias);
+		m_result = &*arg;
+		m_result->setName("result");
+		++arg;
+	}
+	for (auto& param: params)
+	{
+		Value* pVar = m_interp->create_variable(param.second, param.first, entry);
+		arg->setName(param.first);
+		m_interp->assign_variable(pVar, &*arg);
+		++arg;
+	}
+
+	if (m_type == FUNCTION)
+	{
+		// a String starts out empty already
+		m_retval = m_interp->create_variable(nRetType, m_name.c_str(), entry);
+		if (!bStringResult)
+			ir_builder(entry).CreateStore(Constant::getNullValue(retType), m_retval);
+	}
+
+	m_interp->push_context(this);
+	return true;
+}
+
+void sub_stmt::make_exit()
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_CALL);
+	ir_builder builder(m_interp->get_current_block());
+	builder.CreateBr(m_exitBlock);
+	// whatever follows Exit is unreachable, but it still needs a block
+	m_interp->set_current_block(BasicBlock::Create(*m_interp, "", m_function));
+}
+
+void sub_stmt::make_end()
+{
+	construct_scope cs(m_interp->get_stats(), compile_stats::CONSTRUCT_CALL);
+	ir_builder builder(m_interp->get_current_block());
+	builder.CreateBr(m_exitBlock);
+
+	builder.SetInsertPoint(m_exitBlock);
+	Value* pResult = nullptr;
+	if (m_result)
+	{
+		// hand the characters over before the locals are released
+		Value* args[] = { m_result, m_retval };
+		m_interp->call_runtime(builder, "basic_str_move", builder.getVoidTy(), args);
+	}
+	else if (m_retval)
+		pResult = builder.CreateLoad(m_retval);
+	m_interp->leave_procedure(builder);
+	if (pResult)
+		builder.CreateRet(pResult);
+	else
+		builder.CreateRetVoid();
+
+	// back to the top-level code
+	m_interp->set_current_block(m_callerBlock);
+}
+
+Function* interpreter::create_procedure(int tok, const char* pszname, FunctionType* ft)
+{
+	if (m_symbols.lookup_global(pszname))
+	{
+		std::cerr << "error: " << pszname << " is already defined.\n";
+		return nullptr;
+	}
+
+	// in incremental mode, the later statements are compiled
+	// into their own modules, they must be able to link to it,
+	// and so must the programs using a library
+	Function* fn = Function::Create(ft,
+			m_incremental || m_library ? Function::ExternalLinkage : Function::InternalLinkage,
+			procedure_name(pszname), module.get());
+	fn->setCallingConv(CallingConv::Fast);
+	m_symbols.insert(pszname, symbol{ tok, ft, fn });
+	return fn;
+}
+
+void interpreter::enter_procedure(Function* fn)
+{
+	m_functions.push_front(fn);
+	m_symbols.push_scope();
+	// main() keeps its own arrays and Strings to release
+	m_mainHeapArrays.swap(m_heapArrays);
+	m_mainStringArrays.swap(m_stringArrays);
+	m_mainStringSlots.swap(m_stringSlots);
+}
+
+void interpreter::leave_procedure(ir_builder& builder)
+{
+	free_locals(builder);
+	m_heapArrays.swap(m_mainHeapArrays);
+	m_stringArrays.swap(m_mainStringArrays);
+	m_stringSlots.swap(m_mainStringSlots);
+	m_symbols.pop_scope();
+	m_functions.pop_front();
+}
+
+Constant* interpreter::find_function(const char* pszname)
+{
+	symbol* sym = m_symbols.lookup_global(pszname);
+	if (sym && is_procedure(sym))
+	{
+		if (!sym->storage)
+		{
+			// defined by a previous statement in incremental mode,
+			// it only has to be declared in this module
+			Function* fn = Function::Create(static_cast<FunctionType*>(sym->type),
+					Function::ExternalLinkage, procedure_name(pszname), module.get());
+			fn->setCallingConv(CallingConv::Fast);
+			sym->storage = fn;
+		}
+		return static_cast<Constant*>(sym->storage);
+	}
+	return static_cast<Constant*>(module->getFunction(pszname));
+}
+
+Value* interpreter::make_call(const char* pszname, const value_list& args)
+{
+	if (is_builtin(pszname))
+		return make_builtin(pszname, args);
+
+	Constant* pfn = find_function(pszname);
+	if (!pfn || !Function::classof(pfn))
+	{
+		std::cerr << "error: no such Function/Sub: " << pszname << "\n";
+		return nullptr;
+	}
+
+	Function* fn = static_cast<Function*>(pfn);
+	FunctionType* ft = fn->getFunctionType();
+	// the result of a String Function is the hidden first parameter
+	size_t nHidden = fn->hasStructRetAttr() ? 1 : 0;
+	size_t nParams = ft->getNumParams() - nHidden;
+	if (args.size() < nParams || (args.size() > nParams && !ft->isVarArg()))
+	{
+		std::cerr << "error: " << pszname << " expects " << nParams << " argument(s).\n";
+		return nullptr;
+	}
+
+	construct_scope cs(m_stats, compile_stats::CONSTRUCT_CALL);
+	ir_builder builder(m_activeBlock);
+	value_list actual;
+	Value* pResult = nullptr;
+	if (nHidden)
+	{
+		pResult = make_string_temp();
+		actual.push_back(pResult);
+	}
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		Value* pVal = args[i];
+		Type* paramType = i < nParams ? ft->getParamType(i + nHidden) : nullptr;
+		bool bStringParam = paramType == m_stringType->getPointerTo();
+		if (is_string(pVal))
+		{
+			// the C functions (puts, ...) get the characters
+			if (!paramType || paramType == builder.getInt8PtrTy())
+				pVal = string_data(pVal, builder);
+			else if (!bStringParam)
+			{
+				std::cerr << "error: type mismatch, argument " << (i + 1) << " of " << pszname << " is not a String.\n";
+				return nullptr;
+			}
+			actual.push_back(pVal);
+			continue;
+		}
+		if (bStringParam)
+		{
+			std::cerr << "error: type mismatch, argument " << (i + 1) << " of " << pszname << " must be a String.\n";
+			return nullptr;
+		}
+		if (is_variable(pVal))
+			pVal = builder.CreateLoad(pVal);
+		if (paramType)
+			pVal = cast_for_assignment(pVal, paramType);
+		actual.push_back(pVal);
+	}
+
+	CallInst* call = builder.CreateCall(fn, actual);
+	call->setCallingConv(fn->getCallingConv());
+	if (pResult)
+		return pResult;
+	return call;
+}
+
+sub_stmt* interpreter::find_last_sub()
+{
+	for (auto pObj: m_statementList)
+	{
+		if (pObj->type() == SUB || pObj->type() == FUNCTION)
+			return static_cast<sub_stmt*>(pObj);
+	}
+	return nullptr;
+}
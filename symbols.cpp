@@ -0,0 +1,107 @@
+#include "basic.h"
+#include <llvm/ADT/SmallString.h>
+#include <cctype>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// Scoped symbol table
+//
+// BASIC identifiers are case-insensitive, so every name is lower-cased
+// before it goes into (or is looked up from) the table.
+/////////////////////////////////////////////////////////////////////////
+
+static StringRef make_key(const char* pszName, SmallVectorImpl<char>& key)
+{
+	key.clear();
+	for (const char* p = pszName; *p; p++)
+		key.push_back(static_cast<char>(tolower(static_cast<unsigned char>(*p))));
+	return StringRef(key.data(), key.size());
+}
+
+symbol_table::symbol_table()
+{
+	// the module (global) scope is always there
+	m_scopes.emplace_back();
+}
+
+void symbol_table::push_scope()
+{
+	m_scopes.emplace_back();
+}
+
+void symbol_table::pop_scope()
+{
+	// never pop the global scope
+	if (m_scopes.size() > 1)
+		m_scopes.pop_back();
+}
+
+symbol* symbol_table::insert(const char* pszName, const symbol& sym)
+{
+	SmallString<32> key;
+	auto result = m_scopes.back().try_emplace(make_key(pszName, key), sym);
+	if (!result.second)
+		return nullptr;
+	if (m_scopes.size() == 1)
+		m_newGlobals.push_back(result.first->first().str());
+	return &(result.first->second);
+}
+
+symbol* symbol_table::lookup(const char* pszName)
+{
+	SmallString<32> key;
+	StringRef strKey = make_key(pszName, key);
+
+	// the innermost scope wins. A procedure body stops before the module
+	// scope: the variables of main() are allocas of another function (or
+	// globals in incremental mode, where it would work differently), and
+	// the procedures themselves are found with lookup_global()
+	for (auto iter = m_scopes.rbegin(); iter != m_scopes.rend(); iter++)
+	{
+		if (iter + 1 == m_scopes.rend() && m_scopes.size() > 1)
+			break;
+		auto found = iter->find(strKey);
+		if (found != iter->end())
+			return &(found->second);
+	}
+	return nullptr;
+}
+
+symbol* symbol_table::lookup_local(const char* pszName)
+{
+	SmallString<32> key;
+	auto found = m_scopes.back().find(make_key(pszName, key));
+	if (found == m_scopes.back().end())
+		return nullptr;
+	return &(found->second);
+}
+
+symbol* symbol_table::lookup_global(const char* pszName)
+{
+	SmallString<32> key;
+	auto found = m_scopes.front().find(make_key(pszName, key));
+	if (found == m_scopes.front().end())
+		return nullptr;
+	return &(found->second);
+}
+
+void symbol_table::forget_globals()
+{
+	// the storage will be declared again in the next module, on demand
+	// (and the element count of a String array with it)
+	for (auto& entry: m_scopes.front())
+	{
+		entry.second.storage = nullptr;
+		entry.second.count = nullptr;
+	}
+	m_newGlobals.clear();
+}
+
+void symbol_table::drop_new_globals()
+{
+	for (auto& strKey: m_newGlobals)
+		m_scopes.front().erase(strKey);
+	m_newGlobals.clear();
+}
@@ -0,0 +1,174 @@
+#include "basic.h"
+#include "runtime.h"
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Target/TargetOptions.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+
+using namespace basic;
+using namespace llvm;
+
+/////////////////////////////////////////////////////////////////////////
+// The host TargetMachine, used by the optimizer for the
+// target specific cost models (e.g. the loop vectorizer),
+// and by the ahead-of-time backend to emit native objects.
+/////////////////////////////////////////////////////////////////////////
+
+void interpreter::init_native_target()
+{
+	// the -j threads may get here at the same time
+	static std::once_flag initialized;
+	std::call_once(initialized, []() {
+		InitializeNativeTarget();
+		InitializeNativeTargetAsmPrinter();
+		InitializeNativeTargetAsmParser();
+	});
+}
+
+void interpreter::set_cpu(const std::string& strCpu)
+{
+	// must be called before the TargetMachine is created
+	m_target.reset();
+	m_features.clear();
+	m_cpu = strCpu;
+
+	if (m_cpu == "native")
+	{
+		// same as -march=native, tune for the CPU we're running on
+		// and enable everything it supports
+		m_cpu = sys::getHostCPUName();
+		StringMap<bool> hostFeatures;
+		if (sys::getHostCPUFeatures(hostFeatures))
+		{
+			SubtargetFeatures features;
+			for (auto& f: hostFeatures)
+				features.AddFeature(f.first(), f.second);
+			m_features = features.getString();
+		}
+	}
+}
+
+TargetMachine* interpreter::get_target_machine()
+{
+	if (m_target)
+		return m_target.get();
+
+	init_native_target();
+
+	std::string triple = sys::getDefaultTargetTriple();
+	std::string strError;
+	const Target* target = TargetRegistry::lookupTarget(triple, strError);
+	if (!target)
+	{
+		std::cerr << "basic: " << strError << "\n";
+		return nullptr;
+	}
+
+	CodeGenOpt::Level cgLevel = CodeGenOpt::Default;
+	switch (m_optLevel)
+	{
+	case 0:
+		cgLevel = CodeGenOpt::None;
+		break;
+	case 1:
+		cgLevel = CodeGenOpt::Less;
+		break;
+	case 3:
+		cgLevel = CodeGenOpt::Aggressive;
+		break;
+	}
+
+	TargetOptions opt;
+	m_target.reset(target->createTargetMachine(triple, m_cpu, m_features,
+				opt, Optional<Reloc::Model>(Reloc::PIC_), None, cgLevel));
+	return m_target.get();
+}
+
+bool interpreter::emit_object(SmallVectorImpl<char>& buffer)
+{
+	if (!module)
+		return false;
+	raw_svector_ostream dest(buffer);
+	return emit_object(dest);
+}
+
+bool interpreter::emit_object(raw_pwrite_stream& dest)
+{
+	TargetMachine* tm = get_target_machine();
+	if (!tm)
+		return false;
+
+	module->setTargetTriple(tm->getTargetTriple().str());
+	module->setDataLayout(tm->createDataLayout());
+
+	phase_timer timer(m_stats, compile_stats::PHASE_CODEGEN);
+	legacy::PassManager pm;
+	if (tm->addPassesToEmitFile(pm, dest, nullptr, TargetMachine::CGFT_ObjectFile))
+	{
+		std::cerr << "basic: the target cannot emit object files\n";
+		return false;
+	}
+	pm.run(*module);
+	dest.flush();
+	return true;
+}
+
+// libbasicrt.a is installed next to the interpreter,
+// BASIC_RUNTIME points somewhere else
+static std::string runtime_library()
+{
+	const char* env = getenv("BASIC_RUNTIME");
+	if (env && *env)
+		return env;
+	std::string strPath = sys::fs::getMainExecutable(nullptr, nullptr);
+	size_t pos = strPath.rfind('/');
+	strPath = pos == std::string::npos ? std::string(".") : strPath.substr(0, pos);
+	return strPath + "/libbasicrt.a";
+}
+
+bool interpreter::link_executable(const char* pszObject, const char* pszPath, bool bProfile)
+{
+	// let the system compiler driver find the C runtime and libc for us,
+	// clang also knows where its profile runtime is
+	const char* cc = getenv("CC");
+	if (!cc || !*cc)
+		cc = bProfile ? "clang" : "cc";
+
+	std::string strRuntime = runtime_library();
+	std::vector<const char*> argv = { cc, pszObject, strRuntime.c_str(), "-o", pszPath, "-lm" };
+#ifdef BASIC_RUNTIME_TO_CHARS
+	// std::to_chars, for Print
+	argv.push_back("-lstdc++");
+#endif
+	if (bProfile)
+		argv.push_back("-fprofile-instr-generate");
+	argv.push_back(nullptr);
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		std::cerr << "basic: fork failed: " << strerror(errno) << "\n";
+		return false;
+	}
+	if (pid == 0)
+	{
+		execvp(cc, const_cast<char* const*>(argv.data()));
+		std::cerr << "basic: cannot execute " << cc << ": " << strerror(errno) << "\n";
+		_exit(127);
+	}
+
+	int status = 0;
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		std::cerr << "basic: linking " << pszPath << " failed\n";
+		return false;
+	}
+	return true;
+}
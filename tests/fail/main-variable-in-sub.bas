@@ -0,0 +1,5 @@
+Dim total As Long
+Sub AddTo(n As Long)
+total = total + n
+End Sub
+AddTo 5
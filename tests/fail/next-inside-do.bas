@@ -0,0 +1,5 @@
+Dim i As Integer
+For i = 1 To 3
+Do
+Next i
+Loop
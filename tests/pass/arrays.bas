@@ -0,0 +1,30 @@
+Dim i As Long, n As Long, t As Long, s As Double
+Dim small(9) As Long
+Dim big(99999) As Long
+Dim d() As Double
+For i = 0 To 9
+small(i) = i * i
+Next i
+Print small(9)
+For i = 0 To 99999
+big(i) = i
+Next i
+Print big(99999)
+For i = 0 To 99999
+t = t + big(i)
+Next i
+Print t
+n = 4
+ReDim d(n)
+For i = 0 To n
+d(i) = i * 0.5
+Next i
+For i = 0 To n
+s = s + d(i)
+Next i
+Print s
+ReDim d(2)
+Print d(2)
+Dim e(n) As Long
+e(n) = 7
+Print e(4)
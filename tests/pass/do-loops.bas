@@ -0,0 +1,34 @@
+Dim n As Long, i As Long
+n = 0
+Do While n < 3
+n = n + 1
+Print n
+Loop
+Do
+n = n - 1
+If n = 1 Then
+Continue Do
+End If
+Print n
+If n = 0 Then
+Exit Do
+End If
+Loop
+Do Until n = 2
+n = n + 1
+Loop
+Print n
+Do
+n = n + 1
+Loop Until n >= 5
+Print n
+For i = 1 To 10
+If i = 4 Then
+Exit For
+End If
+If i = 2 Then
+Continue For
+End If
+Print i
+Next i
+Print i
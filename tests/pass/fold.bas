@@ -0,0 +1,28 @@
+Dim x As Double, d As Double, e As Double, z As Double
+Dim i As Long, j As Long
+x = 4
+Print x ^ -2
+Print 0.5 ^ -3
+i = 2
+j = 0 - 1
+Print i ^ j
+i = 0 - 1
+j = 0 - 3
+Print i ^ j
+Print 0 ^ 0
+z = 0
+Print z ^ 0
+Print 2 ^ 0.5
+i = 3
+Print i ^ 3
+d = -0.0
+e = d + 0.0
+Print 1 / e
+e = 0.0 + d
+Print 1 / e
+e = d + -0.0
+Print 1 / e
+d = 10
+Print d / 4
+Print d / 0.25
+Print d / 3
@@ -0,0 +1,17 @@
+Dim i As Long, st As Long, hi As Long
+For i = 5 To 1 Step -2
+Print i
+Next i
+st = 0 - 3
+hi = 10
+For i = hi To 0 Step st
+Print i
+Next i
+st = 4
+For i = 1 To hi Step st
+Print i
+Next i
+For i = 3 To 1
+Print "never"
+Next i
+Print i
@@ -0,0 +1,26 @@
+Dim s As Single, d As Double, z As Double
+Print 1; 2; 3
+Print "a", "b"
+Print "x";
+Print "y"
+Print "p",
+Print "q"
+s = 0.1
+d = s
+Print d
+s = 1.0 / 3
+d = 1.0 / 3
+Print s; " "; d
+d = 123456789012
+Print d
+d = 2.5e15
+Print d
+d = -2.5
+Print d
+z = 0
+Print z / z
+Print 1 / z
+Print -1 / z
+s = 16777217
+Print s
+Print True
@@ -0,0 +1,8 @@
+Dim total As Long
+Function AddTo(total As Long, n As Long) As Long
+Dim s As Long
+s = total + n
+AddTo = s
+End Function
+total = AddTo(total, 5)
+Print total
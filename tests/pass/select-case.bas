@@ -0,0 +1,16 @@
+Dim k As Long, lo As Long
+lo = 5
+For k = 1 To 7
+Select Case k
+Case 1, 3
+Print k; " list"
+Case 2 To 4
+Print k; " range"
+Case 3
+Print k; " duplicate"
+Case lo To 6
+Print k; " variable range"
+Case Else
+Print k; " else"
+End Select
+Next k
@@ -0,0 +1,20 @@
+Function Hit(n As Long) As Boolean
+Print "hit "; n
+Hit = True
+End Function
+Dim a As Long, b As Boolean
+a = 0
+If a > 0 AndAlso Hit(1) Then
+Print "wrong 1"
+End If
+If a = 0 OrElse Hit(2) Then
+Print "right 2"
+End If
+If a = 0 AndAlso Hit(3) Then
+Print "right 3"
+End If
+If a > 0 OrElse Hit(4) Then
+Print "right 4"
+End If
+b = a > 0 And Hit(5)
+Print b
@@ -0,0 +1,18 @@
+Dim i As Integer, l As Long, b As Byte, d As Double
+i = 0 - 5
+l = i
+Print l
+d = i
+Print d
+Print i / 2
+If i < 0 Then
+Print "negative"
+End If
+b = 200
+i = b
+Print i
+l = b * 2
+Print l
+i = 0 - 7
+d = i * 0.5
+Print d
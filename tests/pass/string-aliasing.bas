@@ -0,0 +1,19 @@
+Dim s As String, x As String, i As Long
+s = "ab"
+s = s & s
+Print s
+x = "<"
+s = x & s
+Print s
+s = Mid(s, 2, 3)
+Print s
+s = Mid(s, 2)
+Print s
+For i = 1 To 4
+s = s & s
+Next i
+Print Len(s); " "; s
+s = x & s
+Print Len(s)
+s = Mid(s, 30)
+Print s
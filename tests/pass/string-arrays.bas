@@ -0,0 +1,18 @@
+Dim names(2) As String, i As Long, j As Long
+Dim w() As String
+names(0) = "alpha"
+names(1) = "beta"
+names(2) = "a string longer than sixteen characters"
+For i = 0 To 2
+Print names(i); " "; Len(names(i))
+Next i
+For j = 1 To 3
+ReDim w(j)
+For i = 0 To j
+w(i) = names(2) & "!"
+Next i
+Next j
+Print w(3)
+Print Len(w(0))
+ReDim w(1)
+Print Len(w(1))
@@ -0,0 +1,106 @@
+#!/bin/sh
+# make check: every program in tests/pass must compile, and its output
+# under the JIT, with and without --no-fold, must match the .out file
+# next to it. Every program in
+# tests/fail must be rejected with an error, in batch mode and under
+# the JIT. The programs in tests/trap compile, but stop with a runtime
+# error under the JIT, after printing their .out. The lines of
+# tests/session are typed into an incremental session (-i --run), its
+# output must match the .out file. A .flags file next to a program
+# holds extra options for it. The scripts in tests/shell check what
+# takes more than one command (--cache, -l), they get BASIC and WORK.
+
+BASIC=${BASIC:-./basic}
+DIR=$(cd "$(dirname "$0")" && pwd)
+# the session writes session.bas in the current directory
+case $BASIC in
+	/*) ;;
+	*) BASIC=$(pwd)/$BASIC ;;
+esac
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+flags_of()
+{
+	cat "${1%.bas}.flags" 2>/dev/null
+}
+
+# diff the output against the .out of the program
+check_output()
+{
+	if ! diff -u "${1%.bas}.out" "$WORK/out" >&2
+	then
+		echo "FAIL: $1 $2 output differs" >&2
+		failed=1
+	fi
+}
+
+failed=0
+for src in "$DIR"/pass/*.bas
+do
+	extra=$(flags_of "$src")
+	if ! $BASIC -O2 $extra "$src" -o "$WORK/out.ll" >/dev/null 2>"$WORK/err"
+	then
+		echo "FAIL: $src does not compile" >&2
+		cat "$WORK/err" >&2
+		failed=1
+	fi
+	# the folds must not change the results
+	for fold in "" "--no-fold"
+	do
+		if ! $BASIC -O2 $extra $fold --run "$src" -o "$WORK/out.ll" >"$WORK/out" 2>"$WORK/err"
+		then
+			echo "FAIL: $src --run $fold does not compile or run" >&2
+			cat "$WORK/err" >&2
+			failed=1
+		fi
+		check_output "$src" "--run $fold"
+	done
+done
+for src in "$DIR"/fail/*.bas
+do
+	extra=$(flags_of "$src")
+	for flags in "" "--run"
+	do
+		if $BASIC -O2 $extra $flags "$src" -o "$WORK/out.ll" >/dev/null 2>"$WORK/err" \
+			|| ! grep -q error "$WORK/err"
+		then
+			echo "FAIL: $src $flags is not rejected" >&2
+			failed=1
+		fi
+	done
+done
+for src in "$DIR"/trap/*.bas
+do
+	extra=$(flags_of "$src")
+	if ! $BASIC -O2 $extra "$src" -o "$WORK/out.ll" >/dev/null 2>"$WORK/err"
+	then
+		echo "FAIL: $src does not compile" >&2
+		cat "$WORK/err" >&2
+		failed=1
+	fi
+	if $BASIC -O2 $extra --run "$src" -o "$WORK/out.ll" >"$WORK/out" 2>"$WORK/err" \
+		|| ! grep -q error "$WORK/err"
+	then
+		echo "FAIL: $src --run does not stop with an error" >&2
+		failed=1
+	fi
+	check_output "$src" --run
+done
+for src in "$DIR"/session/*.bas
+do
+	# without the banner and the prompts
+	(cd "$WORK" && $BASIC -O2 $(flags_of "$src") -i --run <"$src" 2>"$WORK/err") \
+		| sed -e 's/basic:\$ //g' -e '/^Basic Shell Interpreter/d' >"$WORK/out"
+	check_output "$src" session
+done
+for test in "$DIR"/shell/*.sh
+do
+	if ! BASIC=$BASIC WORK=$WORK sh "$test"
+	then
+		echo "FAIL: $test" >&2
+		failed=1
+	fi
+done
+[ $failed -eq 0 ] && echo "all tests passed"
+exit $failed
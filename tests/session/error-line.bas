@@ -0,0 +1,8 @@
+Function Bump() As Integer
+Print "bump"
+Bump = 1
+End Function
+Dim x As Integer
+x = 2
+x = Bump() +
+Print x
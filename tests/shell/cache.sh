@@ -0,0 +1,70 @@
+#!/bin/sh
+# --cache: a hit replays the same output, every option in
+# get_cache_config() makes a different key, and --cache-size evicts the
+# least recently used files first. Run by tests/run.sh, with BASIC and
+# WORK set.
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+SRC="$DIR/../pass/procedure-locals.bas"
+CACHE="$WORK/cache"
+failed=0
+
+# run with the cache, the counters go to $WORK/stats
+cached()
+{
+	$BASIC -O2 --cache="$CACHE" --stats "$@" -o "$WORK/out.ll" 2>"$WORK/stats"
+}
+
+# expect <count> <counter>: what the last run says about the cache
+expect()
+{
+	if ! grep -q "^ *$1  $2\$" "$WORK/stats"
+	then
+		echo "FAIL: cache: $3, expected $1 $2" >&2
+		grep -A6 'Compile cache' "$WORK/stats" >&2
+		failed=1
+	fi
+}
+
+rm -rf "$CACHE"
+cached --run "$SRC" >"$WORK/cold"
+expect 1 misses "cold run"
+cached --run "$SRC" >"$WORK/warm"
+expect 1 hits "same source and options"
+if ! diff -u "$WORK/cold" "$WORK/warm" >&2
+then
+	echo "FAIL: cache: a hit prints something else" >&2
+	failed=1
+fi
+
+# each one is compiled once, then found
+for flag in -O1 -march=native --no-vectorize --fast-math --no-fold --checked-arith
+do
+	cached $flag --run "$SRC" >/dev/null
+	expect 1 misses "$flag"
+	cached $flag --run "$SRC" >/dev/null
+	expect 1 hits "$flag again"
+done
+# a library has no main() to run
+cached --library --emit=bc "$SRC"
+expect 1 misses "--library"
+cached --library --emit=bc "$SRC"
+expect 1 hits "--library again"
+
+# an old file of 2 MiB is the first to go beyond 1 MiB,
+# what was just stored stays
+rm -rf "$CACHE"
+mkdir -p "$CACHE"
+dd if=/dev/zero of="$CACHE/0000000000000000000000000000000000000000.o" bs=1024 count=2048 2>/dev/null
+touch -t 200001010000 "$CACHE/0000000000000000000000000000000000000000.o"
+cached --cache-size=1 --run "$SRC" >/dev/null
+expect 1 "files evicted" "--cache-size=1"
+if [ -e "$CACHE/0000000000000000000000000000000000000000.o" ]
+then
+	echo "FAIL: cache: the least recently used file is still there" >&2
+	failed=1
+fi
+cached --cache-size=1 --run "$SRC" >/dev/null
+expect 1 hits "after the eviction"
+
+exit $failed
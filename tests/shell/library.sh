@@ -0,0 +1,51 @@
+#!/bin/sh
+# -l: a program calls a Function and a Sub of a library compiled apart
+# with --library --emit=bc. A different library with the same
+# procedures is a different program for the cache. Run by tests/run.sh,
+# with BASIC and WORK set.
+
+DIR=$(cd "$(dirname "$0")" && pwd)/library
+CACHE="$WORK/library-cache"
+failed=0
+
+# library <source> <output>
+library()
+{
+	if ! $BASIC -O2 --library --emit=bc "$1" -o "$2" 2>"$WORK/err"
+	then
+		echo "FAIL: library: $1 does not compile" >&2
+		cat "$WORK/err" >&2
+		failed=1
+	fi
+}
+
+# use <lib.bc> <expected output> [options]
+use()
+{
+	lib=$1
+	expected=$2
+	shift 2
+	if ! $BASIC -O2 -l "$lib" "$@" --run "$DIR/use.bas" -o "$WORK/out.ll" >"$WORK/out" 2>"$WORK/err"
+	then
+		echo "FAIL: library: use.bas -l $lib does not compile or run" >&2
+		cat "$WORK/err" >&2
+		failed=1
+	fi
+	if ! diff -u "$expected" "$WORK/out" >&2
+	then
+		echo "FAIL: library: use.bas -l $lib $* output differs" >&2
+		failed=1
+	fi
+}
+
+library "$DIR/twice.bas" "$WORK/twice.bc"
+library "$DIR/thrice.bas" "$WORK/thrice.bc"
+use "$WORK/twice.bc" "$DIR/use.out"
+
+# the same source, the same options, another library
+rm -rf "$CACHE"
+use "$WORK/twice.bc" "$DIR/use.out" --cache="$CACHE"
+use "$WORK/thrice.bc" "$DIR/use-thrice.out" --cache="$CACHE"
+use "$WORK/twice.bc" "$DIR/use.out" --cache="$CACHE"
+
+exit $failed
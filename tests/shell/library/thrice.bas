@@ -0,0 +1,6 @@
+Function Twice(n As Long) As Long
+Twice = n * 3
+End Function
+Sub Greet(s As String)
+Print "hi "; s
+End Sub
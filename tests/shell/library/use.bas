@@ -0,0 +1,4 @@
+Dim n As Long
+n = Twice(21)
+Print n
+Greet("world")
@@ -0,0 +1,5 @@
+Dim l As Long
+l = 9223372036854775000
+Print l
+l = l + 1000
+Print l
@@ -0,0 +1,4 @@
+Dim a() As Double
+Print "before"
+a(0) = 1.5
+Print "not reached"
@@ -0,0 +1,8 @@
+Dim a(3) As Long, i As Long
+For i = 0 To 3
+a(i) = i * 2
+Next i
+Print a(3)
+i = 4
+a(i) = 1
+Print "not reached"
@@ -0,0 +1,4 @@
+Dim a() As Double
+ReDim a(1000000000000000)
+a(0) = 1
+Print a(0)
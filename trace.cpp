@@ -0,0 +1,72 @@
+#include "trace.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+using namespace basic;
+
+int trace::s_categories = 0;
+int trace::s_level = 1;
+std::atomic<long> trace::s_count(0);
+std::atomic<long> trace::s_nanoseconds(0);
+
+bool trace::configure(const char* pszSpec)
+{
+	static const struct
+	{
+		const char* name;
+		int category;
+	} names[] = {
+		{ "lexer", TRACE_LEXER },
+		{ "parser", TRACE_PARSER },
+		{ "codegen", TRACE_CODEGEN },
+		{ "casts", TRACE_CASTS },
+		{ "all", TRACE_ALL },
+	};
+
+	int categories = 0;
+	int level = 1;
+	std::string spec(pszSpec);
+
+	size_t colon = spec.find(':');
+	if (colon != std::string::npos)
+	{
+		level = atoi(spec.c_str() + colon + 1);
+		if (level <= 0)
+			return false;
+		spec.erase(colon);
+	}
+
+	size_t start = 0;
+	while (start <= spec.size())
+	{
+		size_t end = spec.find(',', start);
+		if (end == std::string::npos)
+			end = spec.size();
+		std::string name = spec.substr(start, end - start);
+
+		bool bFound = false;
+		for (auto& n: names)
+		{
+			if (name == n.name)
+			{
+				categories |= n.category;
+				bFound = true;
+				break;
+			}
+		}
+		if (!bFound)
+			return false;
+		start = end + 1;
+	}
+
+	s_categories = categories;
+	s_level = level;
+	return true;
+}
+
+void trace::write(const std::string& strText)
+{
+	s_count++;
+	std::cerr << strText << "\n";
+}
@@ -0,0 +1,86 @@
+#ifndef BASIC_TRACE_H
+#define BASIC_TRACE_H
+
+// Diagnostic tracing.
+//
+// Everything inside BASIC_TRACE() compiles to nothing unless the
+// interpreter is built with BASIC_ENABLE_TRACE (make TRACE=1), and even
+// then it only runs for the categories enabled with --trace=...
+//
+//   BASIC_TRACE(basic::TRACE_CODEGEN, 1, {
+//       std::string buff("store => ");
+//       ...
+//       basic::trace::write(buff);
+//   });
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace basic
+{
+	enum trace_category
+	{
+		TRACE_LEXER   = 1 << 0,
+		TRACE_PARSER  = 1 << 1,
+		TRACE_CODEGEN = 1 << 2,
+		TRACE_CASTS   = 1 << 3,
+		TRACE_ALL     = TRACE_LEXER | TRACE_PARSER | TRACE_CODEGEN | TRACE_CASTS
+	};
+
+	class trace
+	{
+	public:
+		// "parser,casts", "all", with an optional level: "codegen:2"
+		// returns false if the spec is invalid
+		static bool configure(const char* pszSpec);
+
+		static bool enabled(int category, int level)
+		{ return (s_categories & category) && level <= s_level; }
+
+		// write one record to stderr
+		static void write(const std::string& strText);
+
+		// how many records were written, and the time spent
+		// producing them, so we know what tracing costs.
+		static long get_count() { return s_count; }
+		static double get_overhead() { return s_nanoseconds / 1.0e6; }
+		static void add_overhead(long nanoseconds) { s_nanoseconds += nanoseconds; }
+
+	private:
+		static int s_categories;
+		static int s_level;
+		static std::atomic<long> s_count;
+		static std::atomic<long> s_nanoseconds;
+	};
+
+	// measures a BASIC_TRACE() body
+	class trace_timer
+	{
+	public:
+		trace_timer() : m_start(std::chrono::steady_clock::now()) {}
+		~trace_timer()
+		{
+			auto elapsed = std::chrono::steady_clock::now() - m_start;
+			trace::add_overhead(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		}
+
+	private:
+		std::chrono::steady_clock::time_point m_start;
+	};
+}
+
+#ifdef BASIC_ENABLE_TRACE
+#define BASIC_TRACE(category, level, ...) \
+	do { \
+		if (basic::trace::enabled(category, level)) \
+		{ \
+			basic::trace_timer basic_trace_timer_; \
+			__VA_ARGS__; \
+		} \
+	} while (0)
+#else
+#define BASIC_TRACE(category, level, ...) do { } while (0)
+#endif
+
+#endif /* BASIC_TRACE_H */